@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <pthread.h>
+
+#include "osmem.h"
+#include "block_meta.h"
+#include "arena.h"
+
+/*
+ * Threads are handed the arenas round-robin on their first allocation, so N
+ * threads spread over min(N, arena_max) locks. The arenas past the main one
+ * are mapped the first time a thread is assigned to them and never unmapped.
+ */
+unsigned int arena_max = OSMEM_ARENAS;
+
+static struct arena *arenas[OSMEM_ARENAS] = { &main_arena };
+static unsigned int next_arena;
+static pthread_mutex_t arenas_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread struct arena *thread_arena;
+
+static struct arena *arena_create(void)
+{
+	struct arena *arena;
+	void *ptr, *start;
+	size_t before, after;
+
+	// Map twice the size, so an aligned arena fits somewhere inside
+	ptr = mmap(NULL, 2 * ARENA_SIZE, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	if (ptr == MAP_FAILED)
+		return NULL;
+
+	start = (void *)(((size_t)ptr + ARENA_SIZE - 1) & ~(ARENA_SIZE - 1));
+	before = start - ptr;
+	after = ARENA_SIZE - before;
+
+	// Give back what lies outside the aligned arena
+	if (before != 0)
+		munmap(ptr, before);
+
+	if (after != 0)
+		munmap(start + ARENA_SIZE, after);
+
+	// The mapping is zeroed, so the free index starts out empty
+	arena = start;
+	arena->end = start + ((sizeof(struct arena) + ALIGNMENT - 1) & ~(ALIGNMENT - 1));
+	arena->limit = start + ARENA_SIZE;
+	pthread_mutex_init(&arena->mutex, NULL);
+
+	return arena;
+}
+
+struct arena *arena_get(void)
+{
+	struct arena *arena = thread_arena;
+	unsigned int id;
+
+	if (arena != NULL)
+		return arena;
+
+	id = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % arena_max;
+
+	pthread_mutex_lock(&arenas_mutex);
+
+	arena = arenas[id];
+
+	if (arena == NULL) {
+		arena = arena_create();
+
+		// Share the main arena when no more memory can be mapped
+		if (arena == NULL)
+			arena = &main_arena;
+		else
+			__atomic_store_n(&arenas[id], arena, __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_unlock(&arenas_mutex);
+
+	thread_arena = arena;
+
+	return arena;
+}
+
+struct arena *arena_at(int id)
+{
+	return __atomic_load_n(&arenas[id], __ATOMIC_ACQUIRE);
+}
+
+struct arena *arena_of(struct block_meta *block)
+{
+	struct arena *arena;
+	void *start;
+	int id;
+
+	// The brk heap only grows, so a block below its end belongs to it
+	if (main_arena.head != NULL && block >= main_arena.head &&
+		(void *)block < __atomic_load_n(&main_arena.end, __ATOMIC_RELAXED))
+		return &main_arena;
+
+	start = (void *)((size_t)block & ~(ARENA_SIZE - 1));
+
+	for (id = 1; id < OSMEM_ARENAS; id++) {
+		arena = __atomic_load_n(&arenas[id], __ATOMIC_ACQUIRE);
+
+		if ((void *)arena == start)
+			return arena;
+	}
+
+	return NULL;
+}
@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include "block_meta.h"
+#include "free_index.h"
+#include "lru.h"
+
+#ifdef OSMEM_THREADS
+#include <pthread.h>
+#endif
+
+/*
+ * A heap of contiguous blocks with its own free index.
+ *
+ * The main arena is the brk heap. Thread-safe builds (OSMEM_THREADS) also get
+ * up to OSMEM_ARENAS - 1 more arenas, each living in an ARENA_SIZE mapping
+ * aligned to ARENA_SIZE, with the arena itself at its start. Such an arena
+ * grows inside its mapping like the brk heap grows with sbrk, and the arena of
+ * any of its blocks is found by rounding the block address down.
+ */
+#ifndef OSMEM_ARENAS
+#define OSMEM_ARENAS 1
+#endif
+
+#define ARENA_SIZE	(64UL << 20)
+
+struct arena {
+	struct free_index index;
+
+	/* First and last block, and the end of the heap */
+	struct block_meta *head;
+	struct block_meta *tail;
+	void *end;
+
+	/* End of the mapping, NULL for the brk heap that grows with sbrk */
+	void *limit;
+
+	/* Blocks freed since the last coalesce, linked through `next` */
+	struct block_meta *pending;
+
+	/* Big free blocks waiting to be purged (see purge.h) */
+	struct lru_list dirty;
+
+#ifdef OSMEM_THREADS
+	pthread_mutex_t mutex;
+
+	/* Blocks freed by threads of other arenas, pushed without the lock */
+	struct block_meta *remote;
+#endif
+};
+
+extern struct arena main_arena;
+
+/*
+ * Allocate and free blocks of an arena that no thread is assigned to, such as
+ * the segments of an os_heap_t (see heap.c). The caller serializes the calls.
+ * arena_malloc() returns NULL once the arena is full, arena_free() returns the
+ * size of the block it freed, metadata included, or 0 for an invalid pointer.
+ */
+void *arena_malloc(struct arena *arena, size_t size);
+size_t arena_free(struct arena *arena, void *ptr);
+
+#ifdef OSMEM_THREADS
+
+/* Number of arenas handed out to threads, at most OSMEM_ARENAS */
+extern unsigned int arena_max;
+
+/* Return the arena of the calling thread, assigning one on its first call */
+struct arena *arena_get(void);
+
+/* Return the arena whose heap holds `block`, or NULL for any other address */
+struct arena *arena_of(struct block_meta *block);
+
+/* Return the arena with the given id, or NULL if it was not created yet */
+struct arena *arena_at(int id);
+
+static inline void arena_lock(struct arena *arena)
+{
+	pthread_mutex_lock(&arena->mutex);
+}
+
+static inline void arena_unlock(struct arena *arena)
+{
+	pthread_mutex_unlock(&arena->mutex);
+}
+
+#else
+
+static inline struct arena *arena_get(void)
+{
+	return &main_arena;
+}
+
+static inline struct arena *arena_at(int id)
+{
+	return id == 0 ? &main_arena : NULL;
+}
+
+static inline struct arena *arena_of(struct block_meta *block)
+{
+	if (main_arena.head != NULL && block >= main_arena.head && (void *)block < main_arena.end)
+		return &main_arena;
+
+	return NULL;
+}
+
+static inline void arena_lock(struct arena *arena)
+{
+	(void)arena;
+}
+
+static inline void arena_unlock(struct arena *arena)
+{
+	(void)arena;
+}
+
+#endif
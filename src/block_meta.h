@@ -3,6 +3,7 @@
 #pragma once
 
 #include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
 #include "printf.h"
 
@@ -15,15 +16,47 @@
 		}												\
 	} while (0)
 
+#ifdef OSMEM_COMPACT
+/*
+ * Compact 16 byte metadata: the status and the flags share a word with the
+ * size. Only free blocks need `prev`, so it lives in the first bytes of their
+ * payload, which makes the smallest payload big enough for it and the size
+ * that ends a free block.
+ */
+struct block_meta {
+	size_t status : 2;
+	size_t flags : 6;
+	size_t size : 56;
+	struct block_meta *next;
+	struct block_meta *prev;
+};
+
+#define BLOCK_META_SIZE		offsetof(struct block_meta, prev)
+#define BLOCK_MIN_PAYLOAD	16
+#else
 /* Structure to hold memory block metadata */
 struct block_meta {
 	size_t size;
 	int status;
+	unsigned int flags;
 	struct block_meta *prev;
 	struct block_meta *next;
 };
 
+#define BLOCK_META_SIZE		sizeof(struct block_meta)
+#define BLOCK_MIN_PAYLOAD	8
+#endif
+
 /* Block metadata status values */
 #define STATUS_FREE   0
 #define STATUS_ALLOC  1
 #define STATUS_MAPPED 2
+#define STATUS_CACHED 3	/* Freed into the cache of its thread (tcache.c) */
+
+/* Block metadata flags */
+#define BLOCK_PREV_FREE 0x1	/* The previous heap block is free and its size ends it */
+#define BLOCK_PENDING   0x2	/* Freed, but not coalesced with its neighbours yet */
+#define BLOCK_RED       0x4	/* Red node of the free block tree (rbtree.c) */
+#define BLOCK_ZERO      0x8	/* The inside of the free block reads as zeroes (purge.c) */
+#define BLOCK_DIRTY     0x10	/* The free block waits to be purged (purge.c) */
+#define BLOCK_ALIGNED   0x20	/* The mapped block starts past the start of its mapping */
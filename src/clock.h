@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <time.h>
+
+/* Milliseconds of the coarse monotonic clock, which is read without a system call */
+static inline unsigned long clock_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+	return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include "block_meta.h"
+
+/* The index built by the Makefile (FREE_INDEX) defines struct free_index */
+#ifndef FREE_INDEX_HEADER
+#define FREE_INDEX_HEADER "rbtree.h"
+#endif
+
+#include FREE_INDEX_HEADER
+
+/*
+ * Index of the free blocks on the brk heap.
+ *
+ * Every block with STATUS_FREE on the heap that is not BLOCK_PENDING must be
+ * present in the index, and no other block may be. Sizes are whole block sizes
+ * (metadata included). Every heap (see arena.h) has an index of its own.
+ */
+
+/* Add a free block to the index */
+void free_index_insert(struct free_index *index, struct block_meta *block);
+
+/* Remove a block from the index, before it is allocated, merged or resized */
+void free_index_remove(struct free_index *index, struct block_meta *block);
+
+/* Return the best fitting free block of at least `size` bytes, or NULL */
+struct block_meta *free_index_find(struct free_index *index, size_t size);
@@ -0,0 +1,246 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+
+#include "osmem.h"
+#include "block_meta.h"
+#include "arena.h"
+#include "tunables.h"
+
+/*
+ * A heap is a chain of segments, each one a mapping that starts with an arena
+ * of its own. Blocks are carved from a segment like from the brk heap, with
+ * the same metadata, free index, coalescing and trimming, until the segment is
+ * full and a new one is mapped. Nothing of a heap lives outside its segments,
+ * the heap itself sits in the first one, so destroying it is one munmap() per
+ * segment and leaves no trace in the process-wide heaps.
+ *
+ * Segments are mapped with MAP_NORESERVE and only touched as their arena
+ * grows, so a big segment costs address space rather than memory. A block too
+ * big for a segment gets a segment of its own.
+ */
+#define HEAP_SEGMENT_SIZE	(16UL << 20)
+
+struct heap_segment {
+	struct heap_segment *next;
+	size_t size;
+	struct arena arena;
+};
+
+struct os_heap {
+	/* Newest segment first, the last one holds the heap */
+	struct heap_segment *segments;
+	size_t segment_size;
+
+	/* Bytes of the allocated blocks, metadata included */
+	size_t used;
+
+#ifdef OSMEM_THREADS
+	pthread_mutex_t mutex;
+#endif
+};
+
+#ifdef OSMEM_THREADS
+static inline void heap_lock(os_heap_t *heap)
+{
+	pthread_mutex_lock(&heap->mutex);
+}
+
+static inline void heap_unlock(os_heap_t *heap)
+{
+	pthread_mutex_unlock(&heap->mutex);
+}
+#else
+static inline void heap_lock(os_heap_t *heap)
+{
+	(void)heap;
+}
+
+static inline void heap_unlock(os_heap_t *heap)
+{
+	(void)heap;
+}
+#endif
+
+static size_t align_up(size_t size, size_t alignment)
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static struct heap_segment *map_segment(size_t size, size_t reserved)
+{
+	struct heap_segment *segment;
+	void *ptr;
+
+	ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	if (ptr == MAP_FAILED)
+		return NULL;
+
+	// A fresh mapping reads as zeroes, which is an arena with no blocks yet
+	segment = ptr;
+	segment->size = size;
+	segment->arena.end = ptr + align_up(sizeof(*segment), ALIGNMENT) + reserved;
+	segment->arena.limit = ptr + size;
+
+	return segment;
+}
+
+static struct heap_segment *add_segment(os_heap_t *heap, size_t size)
+{
+	struct heap_segment *segment;
+	size_t chunk = size + BLOCK_META_SIZE;
+	size_t length;
+
+	// The first chunk of an arena is at least heap_prealloc bytes
+	if (chunk < heap_prealloc)
+		chunk = heap_prealloc;
+
+	length = align_up(align_up(sizeof(*segment), ALIGNMENT) + chunk, getpagesize());
+
+	if (length < heap->segment_size)
+		length = heap->segment_size;
+
+	segment = map_segment(length, 0);
+
+	if (segment == NULL)
+		return NULL;
+
+	segment->next = heap->segments;
+	heap->segments = segment;
+
+	return segment;
+}
+
+static struct heap_segment *find_segment(os_heap_t *heap, void *ptr)
+{
+	struct heap_segment *segment;
+
+	for (segment = heap->segments; segment != NULL; segment = segment->next)
+		if (ptr > (void *)segment && ptr < segment->arena.limit)
+			return segment;
+
+	return NULL;
+}
+
+os_heap_t *os_heap_create(size_t segment_size)
+{
+	struct heap_segment *segment;
+	os_heap_t *heap;
+	size_t reserved = align_up(sizeof(*heap), ALIGNMENT);
+
+	if (segment_size == 0)
+		segment_size = HEAP_SEGMENT_SIZE;
+
+	segment_size = align_up(segment_size, getpagesize());
+
+	// The first segment also holds the heap
+	segment = map_segment(segment_size, reserved);
+
+	if (segment == NULL)
+		return NULL;
+
+	heap = (void *)segment + align_up(sizeof(*segment), ALIGNMENT);
+	heap->segments = segment;
+	heap->segment_size = segment_size;
+
+#ifdef OSMEM_THREADS
+	pthread_mutex_init(&heap->mutex, NULL);
+#endif
+
+	return heap;
+}
+
+void *os_heap_malloc(os_heap_t *heap, size_t size)
+{
+	struct heap_segment *segment;
+	void *ptr = NULL;
+
+	// A size this big could not be mapped anyway
+	if (size == 0 || size > PTRDIFF_MAX)
+		return NULL;
+
+	heap_lock(heap);
+
+	// Try the segments from the newest one, which has the most room left
+	for (segment = heap->segments; segment != NULL && ptr == NULL; segment = segment->next)
+		ptr = arena_malloc(&segment->arena, size);
+
+	if (ptr == NULL) {
+		segment = add_segment(heap, size);
+
+		if (segment != NULL)
+			ptr = arena_malloc(&segment->arena, size);
+	}
+
+	if (ptr != NULL)
+		heap->used += ((struct block_meta *)(ptr - BLOCK_META_SIZE))->size;
+
+	heap_unlock(heap);
+
+	return ptr;
+}
+
+void os_heap_free(os_heap_t *heap, void *ptr)
+{
+	struct heap_segment *segment;
+
+	if (ptr == NULL)
+		return;
+
+	heap_lock(heap);
+
+	// Pointers of other heaps are ignored
+	segment = find_segment(heap, ptr);
+
+	if (segment != NULL)
+		heap->used -= arena_free(&segment->arena, ptr);
+
+	heap_unlock(heap);
+}
+
+size_t os_heap_used(os_heap_t *heap)
+{
+	size_t used;
+
+	heap_lock(heap);
+	used = heap->used;
+	heap_unlock(heap);
+
+	return used;
+}
+
+size_t os_heap_size(os_heap_t *heap)
+{
+	struct heap_segment *segment;
+	size_t size = 0;
+
+	heap_lock(heap);
+
+	// Only the part of a segment its arena grew into may be resident
+	for (segment = heap->segments; segment != NULL; segment = segment->next)
+		size += segment->arena.end - (void *)segment;
+
+	heap_unlock(heap);
+
+	return size;
+}
+
+void os_heap_destroy(os_heap_t *heap)
+{
+	struct heap_segment *segment, *next;
+
+	if (heap == NULL)
+		return;
+
+#ifdef OSMEM_THREADS
+	pthread_mutex_destroy(&heap->mutex);
+#endif
+
+	// The heap itself goes away with the last segment
+	for (segment = heap->segments; segment != NULL; segment = next) {
+		next = segment->next;
+		munmap(segment, segment->size);
+	}
+}
@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include "block_meta.h"
+
+/*
+ * List of free blocks in the order they were freed, for the memory that is
+ * given back once it has gone unused for long enough (mmap_cache.c, purge.c).
+ *
+ * The links and the time a block was freed are kept in its payload, past
+ * `prev`, which is in the payload with compact metadata, and past any field a
+ * free index keeps there. Blocks are appended, so the list runs from the
+ * oldest to the newest and the blocks that expired are all at its front. An
+ * empty list is all zeroes.
+ */
+struct lru_entry {
+	struct block_meta *older;
+	struct block_meta *newer;
+	unsigned long freed_at;
+};
+
+struct lru_list {
+	struct block_meta *oldest;
+	struct block_meta *newest;
+};
+
+static inline struct lru_entry *lru_entry(struct block_meta *block)
+{
+	return (struct lru_entry *)((void *)block + sizeof(struct block_meta));
+}
+
+/* Append a block freed at `now` */
+static inline void lru_push(struct lru_list *list, struct block_meta *block, unsigned long now)
+{
+	struct lru_entry *e = lru_entry(block);
+
+	e->older = list->newest;
+	e->newer = NULL;
+	e->freed_at = now;
+
+	if (list->newest != NULL)
+		lru_entry(list->newest)->newer = block;
+	else
+		list->oldest = block;
+
+	list->newest = block;
+}
+
+static inline void lru_del(struct lru_list *list, struct block_meta *block)
+{
+	struct lru_entry *e = lru_entry(block);
+
+	if (e->older != NULL)
+		lru_entry(e->older)->newer = e->newer;
+	else
+		list->oldest = e->newer;
+
+	if (e->newer != NULL)
+		lru_entry(e->newer)->older = e->older;
+	else
+		list->newest = e->older;
+}
+
+/* Return the oldest block if it was freed at least `decay` ms before `now`, or NULL */
+static inline struct block_meta *lru_expired(struct lru_list *list, unsigned long now, unsigned long decay)
+{
+	struct block_meta *block = list->oldest;
+
+	if (block == NULL || now - lru_entry(block)->freed_at < decay)
+		return NULL;
+
+	return block;
+}
@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "osmem.h"
+#include "block_meta.h"
+#include "arena.h"
+#include "mmap_cache.h"
+#include "purge.h"
+#include "tunables.h"
+
+/*
+ * OSMEM_CONF holds comma separated `name:value` pairs, where the names are
+ * those of the os_mallopt() parameters and the values are numbers with an
+ * optional k, m or g suffix, for instance
+ *
+ *	OSMEM_CONF=mmap_threshold_max:32m,purge_threshold:64k,purge_decay:500
+ *
+ * It is read when the library is loaded, before the first allocation, so it
+ * only goes through getenv() and strtol(), which never allocate. Unknown names
+ * and values os_mallopt() refuses are skipped.
+ */
+static const struct {
+	const char *name;
+	int param;
+} options[] = {
+	{ "trim_threshold", OS_M_TRIM_THRESHOLD },
+	{ "mmap_threshold", OS_M_MMAP_THRESHOLD },
+	{ "mmap_threshold_max", OS_M_MMAP_THRESHOLD_MAX },
+	{ "heap_prealloc", OS_M_HEAP_PREALLOC },
+	{ "split_min", OS_M_SPLIT_MIN },
+	{ "mmap_cache_max", OS_M_MMAP_CACHE_MAX },
+	{ "mmap_cache_decay", OS_M_MMAP_CACHE_DECAY },
+	{ "purge_threshold", OS_M_PURGE_THRESHOLD },
+	{ "purge_decay", OS_M_PURGE_DECAY },
+	{ "arena_max", OS_M_ARENA_MAX },
+};
+
+static size_t align_up(long value)
+{
+	if (value % ALIGNMENT != 0)
+		value += (ALIGNMENT - (value % ALIGNMENT));
+
+	return value;
+}
+
+int os_mallopt(int param, long value)
+{
+	if (value < 0)
+		return 0;
+
+	switch (param) {
+	case OS_M_TRIM_THRESHOLD:
+		trim_threshold = value;
+		break;
+	case OS_M_MMAP_THRESHOLD:
+		// The threshold is compared to whole aligned blocks, metadata included
+		if ((size_t)value < BLOCK_META_SIZE + BLOCK_MIN_PAYLOAD)
+			return 0;
+
+		// A threshold set by hand stays where it is, for calloc as well
+		mmap_threshold_min = align_up(value);
+		mmap_threshold_max = mmap_threshold_min;
+		mmap_threshold_set = 1;
+		__atomic_store_n(&mmap_threshold, mmap_threshold_min, __ATOMIC_RELAXED);
+		break;
+	case OS_M_MMAP_THRESHOLD_MAX:
+		if ((size_t)value < BLOCK_META_SIZE + BLOCK_MIN_PAYLOAD)
+			return 0;
+
+		mmap_threshold_max = align_up(value);
+
+		// Lowering the bound pulls down a threshold that already slid past it
+		if (mmap_threshold_min > mmap_threshold_max)
+			mmap_threshold_min = mmap_threshold_max;
+
+		if (__atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) > mmap_threshold_max)
+			__atomic_store_n(&mmap_threshold, mmap_threshold_max, __ATOMIC_RELAXED);
+		break;
+	case OS_M_HEAP_PREALLOC:
+		// The chunk must hold at least one block
+		if ((size_t)value < BLOCK_META_SIZE + BLOCK_MIN_PAYLOAD)
+			return 0;
+
+		heap_prealloc = align_up(value);
+		break;
+	case OS_M_SPLIT_MIN:
+		// A split off block must be able to hold its free list links
+		if ((size_t)value < BLOCK_MIN_PAYLOAD)
+			return 0;
+
+		split_min = align_up(value);
+		break;
+	case OS_M_MMAP_CACHE_MAX:
+		mmap_cache_max = value;
+		break;
+	case OS_M_MMAP_CACHE_DECAY:
+		mmap_cache_decay = value;
+		break;
+	case OS_M_PURGE_THRESHOLD:
+		purge_threshold = value;
+		break;
+	case OS_M_PURGE_DECAY:
+		purge_decay = value;
+		break;
+	case OS_M_ARENA_MAX:
+		// Only the arenas the library was built with exist
+		if (value < 1 || value > OSMEM_ARENAS)
+			return 0;
+
+#ifdef OSMEM_THREADS
+		arena_max = value;
+#endif
+		break;
+	default:
+		return 0;
+	}
+
+	return 1;
+}
+
+static long parse_value(const char *str, char **end)
+{
+	long value = strtol(str, end, 0);
+
+	switch (**end) {
+	case 'g':
+	case 'G':
+		value <<= 10;
+		/* fallthrough */
+	case 'm':
+	case 'M':
+		value <<= 10;
+		/* fallthrough */
+	case 'k':
+	case 'K':
+		value <<= 10;
+		(*end)++;
+		break;
+	}
+
+	return value;
+}
+
+__attribute__((constructor))
+static void read_conf(void)
+{
+	const char *conf = getenv("OSMEM_CONF");
+	const char *next, *colon;
+	char *end;
+	size_t len, i;
+	long value;
+
+	while (conf != NULL) {
+		next = strchr(conf, ',');
+
+		if (next == NULL)
+			next = conf + strlen(conf);
+
+		colon = memchr(conf, ':', next - conf);
+
+		if (colon != NULL) {
+			len = colon - conf;
+			value = parse_value(colon + 1, &end);
+
+			// Only a value that takes up the rest of the pair is used
+			for (i = 0; end != colon + 1 && end == next && i < sizeof(options) / sizeof(options[0]); i++) {
+				if (strlen(options[i].name) == len && strncmp(options[i].name, conf, len) == 0)
+					os_mallopt(options[i].param, value);
+			}
+		}
+
+		conf = *next == ',' ? next + 1 : NULL;
+	}
+}
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "osmem.h"
+#include "block_meta.h"
+#include "clock.h"
+#include "lru.h"
+#include "mmap_cache.h"
+
+#ifdef OSMEM_THREADS
+#include <pthread.h>
+#endif
+
+/*
+ * Cached blocks are binned by the power of two of their size and linked
+ * through `prev` and `next`. They are also on a list in the order they were
+ * freed (see lru.h), which is the order they are evicted in. A block is only
+ * reused for sizes it does not exceed twice, so a small request does not pin
+ * a huge mapping.
+ */
+#define CACHE_BINS	64
+
+size_t mmap_cache_max = MMAP_CACHE_MAX;
+unsigned long mmap_cache_decay = MMAP_CACHE_DECAY;
+
+static struct block_meta *bins[CACHE_BINS];
+static struct lru_list lru;
+static size_t cached_bytes;
+
+#ifdef OSMEM_THREADS
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void cache_lock(void)
+{
+	pthread_mutex_lock(&cache_mutex);
+}
+
+static void cache_unlock(void)
+{
+	pthread_mutex_unlock(&cache_mutex);
+}
+#else
+static void cache_lock(void)
+{
+}
+
+static void cache_unlock(void)
+{
+}
+#endif
+
+static int bin_of(size_t size)
+{
+	return 63 - __builtin_clzl(size);
+}
+
+static void cache_del(struct block_meta *block)
+{
+	int bin = bin_of(block->size);
+
+	if (block->prev != NULL)
+		block->prev->next = block->next;
+	else
+		bins[bin] = block->next;
+
+	if (block->next != NULL)
+		block->next->prev = block->prev;
+
+	lru_del(&lru, block);
+	cached_bytes -= block->size;
+}
+
+static void cache_evict(struct block_meta *block)
+{
+	cache_del(block);
+	munmap(block, block->size);
+}
+
+static void cache_decay(unsigned long now)
+{
+	struct block_meta *block;
+
+	while ((block = lru_expired(&lru, now, mmap_cache_decay)) != NULL)
+		cache_evict(block);
+}
+
+struct block_meta *mmap_cache_get(size_t size)
+{
+	struct block_meta *best = NULL;
+	struct block_meta *block;
+	int bin;
+
+	if (mmap_cache_max == 0)
+		return NULL;
+
+	cache_lock();
+
+	cache_decay(clock_ms());
+
+	// Blocks between size and twice size are in these two bins
+	for (bin = bin_of(size); bin < CACHE_BINS && bin <= bin_of(size) + 1; bin++) {
+		for (block = bins[bin]; block != NULL; block = block->next) {
+			if (block->size < size || block->size > 2 * size)
+				continue;
+
+			if (best == NULL || block->size < best->size)
+				best = block;
+		}
+	}
+
+	if (best != NULL)
+		cache_del(best);
+
+	cache_unlock();
+
+	return best;
+}
+
+int mmap_cache_put(struct block_meta *block)
+{
+	unsigned long now;
+	int bin;
+
+	if (block->size > mmap_cache_max)
+		return 0;
+
+	cache_lock();
+
+	now = clock_ms();
+	cache_decay(now);
+
+	// Make room by dropping the oldest blocks
+	while (cached_bytes + block->size > mmap_cache_max)
+		cache_evict(lru.oldest);
+
+	bin = bin_of(block->size);
+
+	block->prev = NULL;
+	block->next = bins[bin];
+
+	if (bins[bin] != NULL)
+		bins[bin]->prev = block;
+
+	bins[bin] = block;
+
+	lru_push(&lru, block, now);
+	cached_bytes += block->size;
+
+	cache_unlock();
+
+	return 1;
+}
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include "block_meta.h"
+
+/*
+ * Cache of freed mapped blocks.
+ *
+ * Instead of being unmapped, a freed mapped block is kept while the cache
+ * holds less than mmap_cache_max bytes, and is handed out again to a large
+ * allocation that fits it. Blocks unused for mmap_cache_decay milliseconds are
+ * unmapped. A cap of 0 disables the cache.
+ */
+#ifndef MMAP_CACHE_MAX
+#define MMAP_CACHE_MAX		0
+#endif
+
+#ifndef MMAP_CACHE_DECAY
+#define MMAP_CACHE_DECAY	1000
+#endif
+
+extern size_t mmap_cache_max;
+extern unsigned long mmap_cache_decay;
+
+/* Return a cached block of at least `size` bytes (metadata included), or NULL */
+struct block_meta *mmap_cache_get(size_t size);
+
+/* Keep a freed mapped block, return 0 if it must be unmapped instead */
+int mmap_cache_put(struct block_meta *block);
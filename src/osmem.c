@@ -1,81 +1,366 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
+#include <stdint.h>
+
 #include "osmem.h"
 #include "printf.h"
 #include "block_meta.h"
+#include "free_index.h"
+#include "arena.h"
+#include "tcache.h"
+#include "slab.h"
+#include "mmap_cache.h"
+#include "purge.h"
+#include "tunables.h"
+
+
+/*
+ * Blocks on a heap are contiguous, so the block that follows another one
+ * starts right after it and the heap is walked by size. This leaves `prev` and
+ * `next` free to index the free blocks (see free_index.h), while allocated
+ * blocks never sit in the index. Mapped blocks use `next` to chain in the
+ * buckets of mmap_table.
+ *
+ * Free blocks end with a copy of their size (a boundary tag) and the block that
+ * follows them has BLOCK_PREV_FREE set, so both neighbours of a block are found
+ * in constant time. os_free() only queues the block on the pending list of its
+ * arena and the next allocation coalesces the queued blocks with their
+ * neighbours. This way a free does not touch the payload of the block or the
+ * metadata of the next block.
+ *
+ * The brk heap is the main arena, thread-safe builds spread threads over more
+ * arenas (see arena.h). A block always goes back to the arena it came from.
+ */
+struct arena main_arena = {
+#ifdef OSMEM_THREADS
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+#endif
+};
+
+/*
+ * Live mapped blocks, hashed by address and chained through `next`, so a
+ * pointer to a block that was unmapped is ignored without touching it.
+ */
+#define MMAP_TABLE_BITS	8
+
+static struct block_meta *mmap_table[1 << MMAP_TABLE_BITS];
+
+// Free bytes at the end of a heap that make os_free() trim it, 0 never does
+size_t trim_threshold = TRIM_THRESHOLD;
+
+/*
+ * Blocks of mmap_threshold bytes or more (metadata included) are mapped.
+ * Freeing a mapped block raises the threshold past it, up to the maximum, so
+ * the allocations of that size that keep coming back reuse the heap instead.
+ */
+size_t mmap_threshold = MMAP_THRESHOLD_MIN;
+size_t mmap_threshold_min = MMAP_THRESHOLD_MIN;
+size_t mmap_threshold_max = MMAP_THRESHOLD_MAX;
+
+// Set once os_mallopt() chose the threshold, which calloc then follows too
+int mmap_threshold_set;
+
+// Size of the first chunk of a heap, and smallest payload split off a block
+size_t heap_prealloc = MMAP_THRESHHOLD;
+size_t split_min = BLOCK_MIN_PAYLOAD;
+
+#ifdef OSMEM_THREADS
+// Guards mmap_table, taken after the lock of an arena if both are needed
+static pthread_mutex_t mmap_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void mmap_lock(void)
+{
+	pthread_mutex_lock(&mmap_mutex);
+}
 
+static inline void mmap_unlock(void)
+{
+	pthread_mutex_unlock(&mmap_mutex);
+}
+#else
+static inline void mmap_lock(void)
+{
+}
 
-struct block_meta *head_brk;
-struct block_meta *head_mmap;
+static inline void mmap_unlock(void)
+{
+}
+#endif
 
-void coalesce_free_blocks(void)
+static struct block_meta *next_block(struct arena *arena, struct block_meta *block)
+{
+	void *next = (void *)block + block->size;
+
+	if (next >= arena->end)
+		return NULL;
+
+	return (struct block_meta *)next;
+}
+
+static struct block_meta *prev_free_block(struct block_meta *block)
+{
+	// The size of a free block is stored in its last bytes
+	size_t prev_size = *(size_t *)((void *)block - sizeof(size_t));
+
+	return (struct block_meta *)((void *)block - prev_size);
+}
+
+static int is_free(struct block_meta *block)
+{
+	return block->status == STATUS_FREE && !(block->flags & BLOCK_PENDING);
+}
+
+static void update_tail(struct arena *arena, struct block_meta *block)
+{
+	// The block that reaches the end of the heap is the last one
+	if (next_block(arena, block) == NULL)
+		arena->tail = block;
+}
+
+static void *extend_heap(struct arena *arena, size_t increment)
 {
-	struct block_meta *current = head_brk;
+	void *ptr;
 
-	while (current != NULL) {
-		if (current->status == 0 && current->next != NULL && current->next->status == 0) {
-			current->size += current->next->size;
-			current->next = current->next->next;
+	// Mapped arenas grow inside their mapping and may run out of space
+	if (arena->limit != NULL) {
+		if (increment > (size_t)(arena->limit - arena->end))
+			return NULL;
+
+		ptr = arena->end;
+		arena->end = ptr + increment;
+
+		return ptr;
+	}
+
+	// Use sbrk to allocate memory, out of memory the allocation fails
+	ptr = sbrk(increment);
+
+	if (ptr == (void *)-1)
+		return NULL;
+
+	// The program break may start unaligned, move the heap past it
+	if ((size_t)ptr % ALIGNMENT != 0) {
+		size_t pad = ALIGNMENT - (size_t)ptr % ALIGNMENT;
+
+		if (sbrk(pad) == (void *)-1) {
+			sbrk(-(intptr_t)increment);
+			return NULL;
 		}
-		current = current->next;
+
+		ptr += pad;
 	}
+
+	arena->end = ptr + increment;
+
+	return ptr;
 }
 
-void *verify_size(struct block_meta *current, size_t size, void *ptr, size_t copy_size)
+static void mark_free(struct arena *arena, struct block_meta *block)
 {
-	if (current->size + current->next->size >= size + sizeof(struct block_meta)) {
-		// Set the size of the current block to the size of the block we want to allocate
-		current->size = current->size + current->next->size;
+	struct block_meta *next = next_block(arena, block);
 
-		// Set the next of the current block to the next of the next of the current block
-		current->next = current->next->next;
+	// Set the status of the block to free
+	block->status = STATUS_FREE;
+	block->flags &= ~BLOCK_PENDING;
 
-		// Set the status of the current block to allocated
-		current->status = STATUS_ALLOC;
+	// Write the boundary tag and tell the next block about it
+	*(size_t *)((void *)block + block->size - sizeof(size_t)) = block->size;
 
-		// Verify if there is space for another block
-		if (current->size >= 2 * sizeof(struct block_meta) + size + 8) {
-			// Initialize the second block
-			struct block_meta *second_block = (struct block_meta *)((void *)current + size + sizeof(struct block_meta));
+	if (next != NULL)
+		next->flags |= BLOCK_PREV_FREE;
+
+	// Make the block reusable
+	free_index_insert(&arena->index, block);
+	purge_track(arena, block);
+}
+
+static void unmark_free(struct arena *arena, struct block_meta *block)
+{
+	// Take the block out of the index, and out of the purge queue
+	free_index_remove(&arena->index, block);
+	purge_untrack(arena, block);
+}
 
-			// Initialize the size of the second block
-			second_block->size = current->size - size - sizeof(struct block_meta);
+static void mark_alloc(struct arena *arena, struct block_meta *block)
+{
+	struct block_meta *next = next_block(arena, block);
 
-			// Set the status of the second block to free
-			second_block->status = STATUS_FREE;
+	// Set the status of the block to allocated, its payload may get dirty again
+	block->status = STATUS_ALLOC;
+	block->flags &= ~BLOCK_ZERO;
+	block->next = NULL;
 
-			// Set the prev of the second block to the current block
-			second_block->prev = current;
+	if (next != NULL)
+		next->flags &= ~BLOCK_PREV_FREE;
+}
 
-			// Set the next of the second block to the next of the current block
-			second_block->next = current->next;
+static void merge_next_block(struct arena *arena, struct block_meta *block)
+{
+	struct block_meta *next = next_block(arena, block);
 
-			// Set the next of the current block to the second block
-			current->next = second_block;
+	unmark_free(arena, next);
 
-			// Set the size of the current block to the size of the block we want to allocate
-			current->size = size + sizeof(struct block_meta);
+	// Absorb the next block, whose metadata now lies inside the block
+	block->size += next->size;
+	block->flags &= ~BLOCK_ZERO;
 
-			// Set the status of the current block to allocated
-			current->status = STATUS_ALLOC;
+	update_tail(arena, block);
+}
 
-			// Return the pointer to the allocated memory
-			return (void *)current + sizeof(struct block_meta);
+static void free_brk(struct arena *arena, struct block_meta *block);
 
-		// If there is no space for another block
-		} else {
-			// Return the pointer to the allocated memory
-			return (void *)current + sizeof(struct block_meta);
+#ifdef OSMEM_THREADS
+static int free_remote(struct arena *arena, struct block_meta *block)
+{
+	struct block_meta *head;
+
+	// Threads of the arena free their blocks under its lock
+	if (arena == arena_get())
+		return 0;
+
+	head = __atomic_load_n(&arena->remote, __ATOMIC_RELAXED);
+
+	// Push the block on the queue of its arena, retrying when another thread won
+	do {
+		block->next = head;
+	} while (!__atomic_compare_exchange_n(&arena->remote, &head, block, 1,
+					      __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	return 1;
+}
+
+static void drain_remote(struct arena *arena)
+{
+	// Take the whole queue at once, producers start a new one
+	struct block_meta *block = __atomic_exchange_n(&arena->remote, NULL, __ATOMIC_ACQUIRE);
+	struct block_meta *next;
+
+	while (block != NULL) {
+		next = block->next;
+		free_brk(arena, block);
+		block = next;
+	}
+}
+#else
+static int free_remote(struct arena *arena, struct block_meta *block)
+{
+	(void)arena;
+	(void)block;
+	return 0;
+}
+
+static void drain_remote(struct arena *arena)
+{
+	(void)arena;
+}
+#endif
+
+static void coalesce_pending(struct arena *arena)
+{
+	struct block_meta *current;
+	struct block_meta *next;
+
+	// Blocks freed by other threads are coalesced with the rest
+	drain_remote(arena);
+
+	while (arena->pending != NULL) {
+		current = arena->pending;
+		arena->pending = current->next;
+
+		// Merge with the previous block if it is free
+		if (current->flags & BLOCK_PREV_FREE) {
+			struct block_meta *prev = prev_free_block(current);
+
+			unmark_free(arena, prev);
+
+			prev->size += current->size;
+			prev->flags &= ~BLOCK_ZERO;
+			current = prev;
 		}
-	} else {
-		void *new_ptr = os_malloc(size);
 
-		memcpy(new_ptr, ptr, copy_size + sizeof(struct block_meta));
+		// Merge with the next block if it is free
+		next = next_block(arena, current);
 
-		os_free(ptr);
+		if (next != NULL && is_free(next))
+			merge_next_block(arena, current);
 
-		return new_ptr;
+		update_tail(arena, current);
+
+		mark_free(arena, current);
+	}
+
+	// Release the pages of the blocks that stayed free long enough
+	purge_dirty(arena);
+}
+
+static void split_block(struct arena *arena, struct block_meta *block, size_t size)
+{
+	// Verify if there is space for another block
+	if (block->size < 2 * BLOCK_META_SIZE + size + split_min)
+		return;
+
+	// Initialize the second block
+	struct block_meta *second_block = (struct block_meta *)((void *)block + size + BLOCK_META_SIZE);
+
+	// Initialize the size of the second block
+	second_block->size = block->size - size - BLOCK_META_SIZE;
+
+	// The block before the second block is in use, the inside of its end stays zero
+	second_block->flags = block->flags & BLOCK_ZERO;
+	second_block->prev = NULL;
+
+	// Set the size of the block to the size of the block we want to allocate
+	block->size = size + BLOCK_META_SIZE;
+
+	// The second block may be followed by a free block when a block shrinks
+	struct block_meta *next = next_block(arena, second_block);
+
+	if (next != NULL && is_free(next))
+		merge_next_block(arena, second_block);
+
+	update_tail(arena, second_block);
+
+	// Set the status of the second block to free
+	mark_free(arena, second_block);
+}
+
+static void *malloc_unlocked(struct arena *arena, size_t size);
+
+static void *move_block(struct arena *arena, void *ptr, size_t size, size_t copy_size)
+{
+	void *new_ptr = malloc_unlocked(arena, size);
+
+	// Out of memory the block stays where it is
+	if (new_ptr == NULL)
+		return NULL;
+
+	memcpy(new_ptr, ptr, copy_size);
+
+	free_brk(arena, (struct block_meta *)(ptr - BLOCK_META_SIZE));
+
+	return new_ptr;
+}
+
+void *verify_size(struct arena *arena, struct block_meta *current, size_t size, void *ptr, size_t copy_size)
+{
+	struct block_meta *next = next_block(arena, current);
+
+	// Coalesce the following free blocks one at a time until the block is big enough
+	while (next != NULL && is_free(next)) {
+		merge_next_block(arena, current);
+		mark_alloc(arena, current);
+
+		if (current->size >= size + BLOCK_META_SIZE) {
+			split_block(arena, current, size);
+
+			// Return the pointer to the allocated memory
+			return (void *)current + BLOCK_META_SIZE;
+		}
+
+		next = next_block(arena, current);
 	}
+
+	return move_block(arena, ptr, size, copy_size);
 }
 
 size_t min(size_t a, size_t b)
@@ -85,315 +370,562 @@ size_t min(size_t a, size_t b)
 	return b;
 }
 
-void *os_malloc(size_t size)
+// Part of a new block that is known to read as zeroes
+struct zero_span {
+	void *start;
+	void *end;
+};
+
+// The payload of a block fresh from the system reads as zeroes
+static void zero_payload(struct zero_span *zero, struct block_meta *block)
 {
-	//If the size is 0, return NULL
-	if (size == 0)
-		return NULL;
+	if (zero == NULL)
+		return;
 
-	// Align the size
-	if (size % ALIGNMENT != 0)
-		size += (ALIGNMENT - (size % ALIGNMENT));
+	zero->start = (void *)block + BLOCK_META_SIZE;
+	zero->end = (void *)block + block->size;
+}
 
-	//Verify if the first block was allocated and if the size is smaller than the threshold
-	if (head_brk == NULL && size < MMAP_THRESHHOLD - sizeof(struct block_meta)) {
-		// Initialize the first block
-		void *ptr = sbrk(MMAP_THRESHHOLD);
+static void *alloc_brk(struct arena *arena, size_t size, struct zero_span *zero)
+{
+	struct block_meta *block;
 
-		DIE(ptr == (void *)-1, "sbrk failed");
+	// The block must be able to hold its free list links once it is freed
+	if (size < BLOCK_MIN_PAYLOAD)
+		size = BLOCK_MIN_PAYLOAD;
 
-		// Initialize the first block
-		struct block_meta *block = (struct block_meta *)ptr;
+	//Verify if the first block was allocated
+	if (arena->head == NULL) {
+		// Preallocate the heap, more if the mmap threshold was raised past it
+		size_t chunk = size + BLOCK_META_SIZE > heap_prealloc ? size + BLOCK_META_SIZE : heap_prealloc;
 
-		// Initialize the size and status of the first block
-		block->size = size + sizeof(struct block_meta);
+		block = extend_heap(arena, chunk);
 
-		// Set the status of the first block to allocated
+		if (block == NULL)
+			return NULL;
+
+		// The first block owns the whole preallocated chunk until it is split
+		block->size = chunk;
+
+		// Set the status of the first block to allocated, the chunk is fresh from the system
 		block->status = STATUS_ALLOC;
+		block->flags = BLOCK_ZERO;
 
 		// Set the prev and next of the first block to NULL
 		block->prev = NULL;
 		block->next = NULL;
 
-		// Set the head_brk to the first block
-		head_brk = block;
+		// Set the head and the tail of the heap to the first block
+		arena->head = block;
+		arena->tail = block;
 
 		//Verify if in the allocated memory there is enough space for another block
-		if (size < 131000) { // poate sa fie <= 131000
-			// Initialize the second block
-			struct block_meta *second_block = head_brk + size + sizeof(struct block_meta);
+		split_block(arena, block, size);
+		block->flags = 0;
+
+		zero_payload(zero, block);
 
-			// Initialize the size
-			second_block->size = MMAP_THRESHHOLD - size - sizeof(struct block_meta);
+		// Return the pointer to the allocated memory
+		return (void *)block + BLOCK_META_SIZE;
+	}
 
-			// Set the status of the second block to free
-			second_block->status = STATUS_FREE;
+	//Coalesce the free blocks
+	coalesce_pending(arena);
 
-			// Set the prev to the first block
-			second_block->prev = head_brk;
+	// Look up the best fit block in the size classes
+	block = free_index_find(&arena->index, size + BLOCK_META_SIZE);
 
-			// Set the next to NULL
-			second_block->next = NULL;
+	// Verify if the best fit block exists
+	if (block != NULL) {
+		unmark_free(arena, block);
+
+		// The inside of a fresh or purged block reads as zeroes until it is written
+		if (zero != NULL && (block->flags & BLOCK_ZERO))
+			purge_span(block, &zero->start, &zero->end);
+
+		// Verify if there is space for another block
+		split_block(arena, block, size);
+
+		// Set the status of the best fit block to allocated
+		mark_alloc(arena, block);
 
-			// Set the next of the first block to the second block
-			head_brk->next = second_block;
-		}
 		// Return the pointer to the allocated memory
-		return (void *)block + sizeof(struct block_meta); // Return the pointer to the allocated memory
+		return (void *)block + BLOCK_META_SIZE;
 	}
 
-	// Verify if the first block was allocated and if there is enough space for another block
-	if (head_brk != NULL && size < MMAP_THRESHHOLD - sizeof(struct block_meta)) {
-		//Coalesce the free blocks
-		coalesce_free_blocks();
-
-		// Initialize the current block
-		struct block_meta *current = head_brk;
-
-		// Initialize the best fit block
-		struct block_meta *best_fit = NULL;
-
-		//Going through the allocated memory to find the best fit block
-		while (current != NULL) {
-			// Verify if the current block is free and if the size of the block is bigger/equal
-			// than the size of the block we want to allocate
-			if (current->status == STATUS_FREE && current->size >= size + sizeof(struct block_meta)) {
-				// Verify if the best fit block is NULL
-				if (best_fit == NULL) {
-					best_fit = current;
-					// Or if the size of the current block is smaller
-				} else if (current->size < best_fit->size) {
-					best_fit = current;
-				}
-			}
-
-			// Go to the next block
-			current = current->next;
+	// Verify if the last block is free, it is too small or it would have been the best fit
+	if (arena->tail->status == STATUS_FREE) {
+		block = arena->tail;
+
+		// Use sbrk to expand the last block
+		if (extend_heap(arena, size + BLOCK_META_SIZE - block->size) == NULL)
+			return NULL;
+
+		// Only the memory past the old end of the heap is fresh
+		if (zero != NULL) {
+			zero->start = (void *)block + block->size;
+			zero->end = arena->end;
 		}
 
-		// Verify if the best fit block exists
-		if (best_fit != NULL) {
-			// Verify if there is space for another block
-			if (best_fit->size >= 2 * sizeof(struct block_meta) + size + 8) {
-				// Initialize the second block
-				struct block_meta *second_block = (struct block_meta *)((void *)best_fit + size + sizeof(struct block_meta));
+		unmark_free(arena, block);
 
-				// Initialize the size of the second block
-				second_block->size = best_fit->size - size - sizeof(struct block_meta);
+		// Set the size of the last block to the size of the block we want to allocate
+		block->size = size + BLOCK_META_SIZE;
 
-				// Set the status of the second block to free
-				second_block->status = STATUS_FREE;
+		// Set the status of the last block to allocated
+		mark_alloc(arena, block);
 
-				// Set the prev of the second block to the best fit block
-				second_block->prev = best_fit;
+		// Return the pointer to the allocated memory
+		return (void *)block + BLOCK_META_SIZE;
+	}
 
-				// Set the next of the second block to the next of the best fit block
-				second_block->next = best_fit->next;
+	// Use sbrk to allocate memory
+	block = extend_heap(arena, size + BLOCK_META_SIZE);
 
-				// Set the next of the best fit block to the second block
-				best_fit->next = second_block;
+	if (block == NULL)
+		return NULL;
 
-				// Set the size of the best fit block to the size of the block we want to allocate
-				best_fit->size = size + sizeof(struct block_meta);
+	// Initialize the size of the block
+	block->size = size + BLOCK_META_SIZE;
 
-				// Set the status of the best fit block to allocated
-				best_fit->status = STATUS_ALLOC;
+	// Set the status of the block to allocated, the last block was not free
+	block->status = STATUS_ALLOC;
+	block->flags = 0;
 
-				// Return the pointer to the allocated memory
-				return (void *)best_fit + sizeof(struct block_meta);
+	// The block is now the last one
+	block->prev = NULL;
+	block->next = NULL;
+	arena->tail = block;
 
-			// If there is no space for another block
-			} else {
-				// Set the status of the best fit block to allocated
-				best_fit->status = STATUS_ALLOC;
+	zero_payload(zero, block);
 
-				// Return the pointer to the allocated memory
-				return (void *)best_fit + sizeof(struct block_meta);
-			}
+	// Return the pointer to the allocated memory
+	return (void *)block + BLOCK_META_SIZE;
+}
 
-		// If the best_fit block does not exist
-		} else {
-			// Initialize the current block
-			struct block_meta *current = head_brk;
+static void *alloc_heap(struct arena *arena, size_t size, struct zero_span *zero)
+{
+	void *ptr = alloc_brk(arena, size, zero);
 
-			// Going through the allocated memory to find the last block
-			while (current->next != NULL)
-				current = current->next;
+	// A full mapped arena falls back to the brk heap, which only fails out of memory
+	if (ptr == NULL && arena != &main_arena) {
+		arena_lock(&main_arena);
+		ptr = alloc_brk(&main_arena, size, zero);
+		arena_unlock(&main_arena);
+	}
 
-			// Verify if the last block is free
-			if (current->status == STATUS_FREE) {
-				// Verify if the size of the last block is smaller than the size of the block we want to allocate
-				if (size + sizeof(struct block_meta) > current->size) {
-					// Use sbrk to allocate memory
-					void *ptr = sbrk(size + sizeof(struct block_meta) - current->size);
+	return ptr;
+}
 
-					// Verify if sbrk failed
-					DIE(ptr == (void *)-1, "sbrk failed");
+static struct block_meta **mmap_bucket(struct block_meta *block)
+{
+	// Mappings are pages apart, so hash the page number with a multiplier
+	size_t page = (size_t)block >> 12;
+
+	return &mmap_table[(page * 0x9E3779B97F4A7C15UL) >> (64 - MMAP_TABLE_BITS)];
+}
+
+static void mmap_table_add(struct block_meta *block)
+{
+	struct block_meta **bucket = mmap_bucket(block);
+
+	mmap_lock();
 
-					// Set the size of the last block to the size of the block we want to allocate
-					current->size = size + sizeof(struct block_meta);
+	block->next = *bucket;
+	*bucket = block;
 
-					// Set the status of the last block to allocated
-					current->status = STATUS_ALLOC;
+	mmap_unlock();
+}
 
-					// Return the pointer to the allocated memory
-					return (void *)current + sizeof(struct block_meta);
-				}
-			} else if (current->status == STATUS_ALLOC) {
-				// Use sbrk to allocate memory
-				void *ptr = sbrk(size + sizeof(struct block_meta));
+static void mmap_table_del(struct block_meta *block)
+{
+	struct block_meta **link = mmap_bucket(block);
 
-				// Verify if sbrk failed
-				DIE(ptr == (void *)-1, "sbrk failed");
+	mmap_lock();
 
-				// Initialize the block
-				struct block_meta *block = (struct block_meta *)ptr;
+	while (*link != block)
+		link = &(*link)->next;
 
-				// Initialize the size of the block
-				block->size = size + sizeof(struct block_meta);
+	*link = block->next;
 
-				// Set the status of the block to allocated
-				block->status = STATUS_ALLOC;
+	mmap_unlock();
+}
 
-				// Set the prev of the block to the current block
-				block->prev = current;
+static int mmap_table_has(struct block_meta *block)
+{
+	struct block_meta *current;
 
-				// Set the next of the block to
-				block->next = current->next;
+	mmap_lock();
 
-				// Set the next of the current block to the block
-				current->next = block;
+	// Only the blocks of the bucket are read, never the one looked up
+	current = *mmap_bucket(block);
 
-				// Return the pointer to the allocated memory
-				return (void *)block + sizeof(struct block_meta);
-			}
-		}
+	while (current != NULL && current != block)
+		current = current->next;
+
+	mmap_unlock();
+
+	return current != NULL;
+}
+
+static void *alloc_mmap(size_t size, struct zero_span *zero)
+{
+	// Reuse a cached mapping if one fits, it keeps its own size
+	struct block_meta *block = mmap_cache_get(size + BLOCK_META_SIZE);
+
+	if (block == NULL) {
+		// Use mmap to allocate memory
+		void *ptr = mmap(NULL, size + BLOCK_META_SIZE, PROT_READ | PROT_WRITE,
+						 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		// Verify if mmap failed
+		if (ptr == MAP_FAILED)
+			return NULL;
+
+		// Initialize the block
+		block = (struct block_meta *)ptr;
+
+		// Initialize the size of the block
+		block->size = size + BLOCK_META_SIZE;
+
+		zero_payload(zero, block);
 	}
 
-	// Need to use mmap for allocation
-	if (size >= MMAP_THRESHHOLD) {
-		// Verify if the head is initialized
-		if (head_mmap == NULL) {
-			// Use mmap to allocate memory
-			void *ptr = mmap(NULL, size + sizeof(struct block_meta), PROT_READ
-							 | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	// Set the status of the block to mapped
+	block->status = STATUS_MAPPED;
+	block->flags = 0;
 
-			// Verify if mmap failed
-			DIE(ptr == (void *)-1, "mmap failed");
+	mmap_table_add(block);
 
-			// Initialize the block
-			struct block_meta *block = (struct block_meta *)ptr;
+	// Return the pointer to the allocated memory
+	return (void *)block + BLOCK_META_SIZE;
+}
 
-			// Initialize the size of the block
-			block->size = size + sizeof(struct block_meta);
+static void raise_mmap_threshold(struct block_meta *block)
+{
+	// Threads may race here, any of the raised values will do
+	size_t threshold = __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED);
 
-			// Set the status of the block to mapped
-			block->status = STATUS_MAPPED;
+	if (block->size >= threshold && block->size < mmap_threshold_max)
+		__atomic_store_n(&mmap_threshold, block->size + ALIGNMENT, __ATOMIC_RELAXED);
+}
 
-			// Set the prev of the block to NULL
-			block->prev = NULL;
+static void *malloc_unlocked(struct arena *arena, size_t size)
+{
+	// Small blocks go on the heap, the rest is mapped
+	if (size + BLOCK_META_SIZE < __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+		return alloc_heap(arena, size, NULL);
 
-			// Set the next of the block to NULL
-			block->next = NULL;
+	return alloc_mmap(size, NULL);
+}
 
-			// Set the head_mmap to the block
-			head_mmap = block;
+void *os_malloc(size_t size)
+{
+	struct arena *arena;
+	void *ptr;
 
-			// Return the pointer to the allocated memory
-			return (void *)block + sizeof(struct block_meta);
+	//If the size is 0, return NULL
+	if (size == 0)
+		return NULL;
+
+	// A size this big could not be mapped anyway, and would wrap once aligned
+	if (size > PTRDIFF_MAX)
+		return NULL;
+
+	// Align the size
+	if (size % ALIGNMENT != 0)
+		size += (ALIGNMENT - (size % ALIGNMENT));
 
-		// If there is at least one block of memory mapped
-		} else if (head_mmap != NULL) {
-			void *ptr = mmap(NULL, size + sizeof(struct block_meta), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	// Small blocks freed by this thread are reused without any lock
+	ptr = tcache_get(size);
+	if (ptr != NULL)
+		return ptr;
 
-			// Verify if mmap failed
-			DIE(ptr == (void *)-1, "mmap failed");
+	// Small objects are packed in slabs, without metadata
+	ptr = slab_alloc(size);
+	if (ptr != NULL)
+		return ptr;
 
-			// Initialize the block
-			struct block_meta *block = (struct block_meta *)ptr;
+	arena = arena_get();
 
-			// Initialize the size of the block
-			block->size = size + sizeof(struct block_meta);
+	arena_lock(arena);
+	ptr = malloc_unlocked(arena, size);
+	arena_unlock(arena);
 
-			// Set the status of the block to mapped
-			block->status = STATUS_MAPPED;
+	return ptr;
+}
 
-			// Go to the last block
-			struct block_meta *current = head_mmap;
+static struct block_meta *find_block(struct arena *arena, void *ptr)
+{
+	struct block_meta *block = (struct block_meta *)(ptr - BLOCK_META_SIZE);
 
-			while (current->next != NULL)
-				current = current->next;
+	// Payloads are always aligned
+	if ((size_t)ptr % ALIGNMENT != 0)
+		return NULL;
 
-			// Set the prev of the block to the current block
-			block->prev = current;
+	// Heap blocks lie between the start and the end of the heap of their arena
+	if (arena != NULL) {
+		if (arena->head == NULL || block < arena->head || ptr >= arena->end)
+			return NULL;
 
-			// Set the next of the block to NULL
-			block->next = NULL;
+		if (block->status != STATUS_ALLOC && block->status != STATUS_FREE)
+			return NULL;
 
-			// Set the next of the current block to the block
-			current->next = block;
+		// The block must end inside the heap
+		if (block->size < BLOCK_META_SIZE || block->size > (size_t)(arena->end - (void *)block))
+			return NULL;
 
-			// Return the pointer to the allocated memory
-			return (void *)block + sizeof(struct block_meta);
-		}
+		return block;
 	}
 
-	return NULL;
+	// A mapped block is only read while its mapping is live
+	if (!mmap_table_has(block))
+		return NULL;
+
+	return block;
 }
 
-void os_free(void *ptr)
+static void free_mapped(struct block_meta *block)
 {
-	// Verify if the pointer is NULL
-	if (ptr == NULL)
+	void *start;
+
+	// Set the status of the block to free
+	block->status = STATUS_FREE;
+
+	mmap_table_del(block);
+	raise_mmap_threshold(block);
+
+	// Keep the mapping for a later allocation if the cache has room
+	if (!(block->flags & BLOCK_ALIGNED) && mmap_cache_put(block))
 		return;
-	// Use a pointer to go through the allocated memory with brk
-	struct block_meta *current_brk = head_brk;
-
-	//Parse the allocated memory in brk
-	while (current_brk != NULL) {
-		// Verify if the pointer is the same as the pointer to the current block
-		if ((void *)current_brk + sizeof(struct block_meta) == ptr) {
-			// Set the status of the current block to free
-			current_brk->status = STATUS_FREE;
-
-			coalesce_free_blocks();
-			return;
-		}
 
-		// Go to the next block
-		current_brk = current_brk->next;
+	// Use munmap to free the memory, from the page the block starts on
+	start = (void *)((size_t)block & ~((size_t)getpagesize() - 1));
+	munmap(start, (void *)block + block->size - start);
+}
+
+static void free_brk(struct arena *arena, struct block_meta *block)
+{
+	// Ignore blocks that are already free
+	if (block->status != STATUS_ALLOC)
+		return;
+
+	// Set the status of the block to free
+	block->status = STATUS_FREE;
+
+	// Queue the block, it is coalesced by the next allocation
+	block->flags |= BLOCK_PENDING;
+	block->next = arena->pending;
+	arena->pending = block;
+}
+
+static int trim_heap(struct arena *arena, size_t pad, size_t threshold)
+{
+	struct block_meta *tail;
+	void *new_end;
+	size_t release;
+
+	// The last block is only free once the pending blocks are coalesced
+	coalesce_pending(arena);
+
+	tail = arena->tail;
+
+	if (tail == NULL || tail->status != STATUS_FREE)
+		return 0;
+
+	// Keep the metadata of the last block, `pad` bytes and the rest of the page
+	new_end = (void *)tail + BLOCK_META_SIZE + BLOCK_MIN_PAYLOAD + pad;
+	new_end = (void *)(((size_t)new_end + getpagesize() - 1) & ~((size_t)getpagesize() - 1));
+
+	if (new_end >= arena->end)
+		return 0;
+
+	release = arena->end - new_end;
+
+	if (release < threshold)
+		return 0;
+
+	unmark_free(arena, tail);
+
+	if (arena->limit != NULL) {
+		// Mapped arenas drop the pages but keep the address space
+		madvise(new_end, release, MADV_DONTNEED);
+	} else {
+		// Use sbrk to lower the program break
+		DIE(sbrk(-(intptr_t)release) == (void *)-1, "sbrk failed");
 	}
 
-	// Use a pointer to go through the allocated memory with mmap
-	struct block_meta *current_mmap = head_mmap;
+	arena->end = new_end;
 
+	// The last block now ends at the new end of the heap
+	tail->size = new_end - (void *)tail;
+	mark_free(arena, tail);
 
-	//Parse the allocated memory in mmap
-	while (current_mmap != NULL) {
-		// Verify if the pointer is the same as the pointer to the current block
-		if ((void *)current_mmap + sizeof(struct block_meta) == ptr) {
-			// Set the status of the current block to free
-			current_mmap->status = STATUS_FREE;
+	return 1;
+}
 
-			// If the current block is the head, set the head to the next block
-			if (current_mmap == head_mmap)
-				head_mmap = current_mmap->next;
+int os_malloc_trim(size_t pad)
+{
+	struct arena *arena;
+	int released = 0;
+	int id;
 
-			// If the current block is not the head, set the next of the previous block to the next of the current block
-			if (current_mmap->prev != NULL)
-				current_mmap->prev->next = current_mmap->next;
+	// Align the pad
+	if (pad % ALIGNMENT != 0)
+		pad += (ALIGNMENT - (pad % ALIGNMENT));
 
-			// If the current block is not the last block, set the prev of the next block to the prev of the current block
-			if (current_mmap->next != NULL)
-				current_mmap->next->prev = current_mmap->prev;
+	for (id = 0; id < OSMEM_ARENAS; id++) {
+		arena = arena_at(id);
 
-			// Use munmap to free the memory
-			munmap(current_mmap, current_mmap->size);
+		if (arena == NULL)
+			continue;
 
-			return;
-		}
-		current_mmap = current_mmap->next;
+		arena_lock(arena);
+		released |= trim_heap(arena, pad, 0);
+		arena_unlock(arena);
 	}
+
+	return released;
+}
+
+#ifdef OSMEM_THREADS
+void heap_free(struct block_meta *block)
+{
+	struct arena *arena = arena_of(block);
+
+	arena_lock(arena);
+	free_brk(arena, block);
+	arena_unlock(arena);
+}
+#endif
+
+static void auto_trim(struct arena *arena)
+{
+	// Give a large free end of the heap back to the system. The block may have
+	// been freed next to the end, so the end is only known once coalesced
+	if (trim_threshold != 0)
+		trim_heap(arena, 0, trim_threshold);
+}
+
+static void free_heap(struct arena *arena, struct block_meta *block)
+{
+	// Blocks of other arenas are queued on them
+	if (free_remote(arena, block))
+		return;
+
+	arena_lock(arena);
+	free_brk(arena, block);
+
+	auto_trim(arena);
+
+	arena_unlock(arena);
+}
+
+void *arena_malloc(struct arena *arena, size_t size)
+{
+	// Align the size
+	if (size % ALIGNMENT != 0)
+		size += (ALIGNMENT - (size % ALIGNMENT));
+
+	return alloc_brk(arena, size, NULL);
+}
+
+size_t arena_free(struct arena *arena, void *ptr)
+{
+	struct block_meta *block = find_block(arena, ptr);
+	size_t size;
+
+	if (block == NULL || block->status != STATUS_ALLOC)
+		return 0;
+
+	size = block->size;
+	free_brk(arena, block);
+
+	auto_trim(arena);
+
+	return size;
+}
+
+/*
+ * Free the block of a pointer, which must be one the allocator handed out. A
+ * size other than 0 is one the block is known to hold, which spares the slab
+ * lookup when no slab object is that big.
+ */
+static void free_ptr(void *ptr, size_t size)
+{
+	struct block_meta *block;
+	struct arena *arena;
+
+	// Slab objects have no metadata before them
+	if (size <= SLAB_MAX_SIZE && slab_owns(ptr)) {
+		slab_free(ptr);
+		return;
+	}
+
+	// The arena of a heap block follows from its address, mapped blocks have none
+	arena = arena_of((struct block_meta *)(ptr - BLOCK_META_SIZE));
+
+	// The metadata is right before the payload
+	block = find_block(arena, ptr);
+
+	if (block == NULL)
+		return;
+
+	if (arena == NULL) {
+		free_mapped(block);
+		return;
+	}
+
+	// Small heap blocks are kept by this thread for its next allocations
+	if (tcache_put(block))
+		return;
+
+	free_heap(arena, block);
+}
+
+void os_free(void *ptr)
+{
+	// Verify if the pointer is NULL
+	if (ptr == NULL)
+		return;
+
+	free_ptr(ptr, 0);
+}
+
+void os_free_sized(void *ptr, size_t size)
+{
+	if (ptr == NULL)
+		return;
+
+	// Align the size
+	if (size % ALIGNMENT != 0)
+		size += (ALIGNMENT - (size % ALIGNMENT));
+
+#ifdef OSMEM_DEBUG
+	// The size may be anything from the requested size to the usable one
+	if (os_malloc_usable_size(ptr) < size) {
+		fprintf(stderr, "os_free_sized(): %p holds less than %zu bytes\n", ptr, size);
+		abort();
+	}
+#endif
+
+	free_ptr(ptr, size);
+}
+
+static void zero_fill(void *ptr, size_t size, struct zero_span *zero)
+{
+	void *end = ptr + size;
+	void *start = zero->start > ptr ? zero->start : ptr;
+	void *stop = zero->end < end ? zero->end : end;
+
+	if (start >= stop) {
+		memset(ptr, 0, size);
+		return;
+	}
+
+	// Only clear what lies around the part that is already zero
+	memset(ptr, 0, start - ptr);
+	memset(stop, 0, end - stop);
 }
 
 void *os_calloc(size_t nmemb, size_t size)
@@ -401,409 +933,518 @@ void *os_calloc(size_t nmemb, size_t size)
 	size_t total_size = nmemb * size;
 
 	size_t page_size = getpagesize();
+	size_t threshold = __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED);
+
+	// Zeroed blocks are mapped from a page on, unless the threshold slid up or was set
+	if (threshold == mmap_threshold_min && !mmap_threshold_set)
+		threshold = page_size;
+
 	//If the size is 0, return NULL
 	if (total_size == 0)
 		return NULL;
 
+	// Refuse sizes that overflow or could not be mapped anyway
+	if (total_size / size != nmemb || total_size > PTRDIFF_MAX)
+		return NULL;
+
 	// Align the size
 	if (total_size % ALIGNMENT != 0)
 		total_size += (ALIGNMENT - (total_size % ALIGNMENT));
 
-	//Verify if the first block was allocated and if the size is smaller than the threshold
-	if (head_brk == NULL && total_size < page_size - sizeof(struct block_meta)) {
-		// Initialize the first block
-		void *ptr = sbrk(MMAP_THRESHHOLD);
+	struct zero_span zero = { NULL, NULL };
+	void *ptr = tcache_get(total_size);
 
-		DIE(ptr == (void *)-1, "sbrk failed");
+	if (ptr == NULL)
+		ptr = slab_alloc(total_size);
 
-		// Initialize the first block
-		struct block_meta *block = (struct block_meta *)ptr;
+	// Blocks smaller than the threshold go on the heap, the rest is mapped
+	if (ptr == NULL && total_size + BLOCK_META_SIZE < threshold) {
+		struct arena *arena = arena_get();
 
-		// Initialize the size and status of the first block
-		block->size = total_size + sizeof(struct block_meta);
+		arena_lock(arena);
+		ptr = alloc_heap(arena, total_size, &zero);
+		arena_unlock(arena);
+	} else if (ptr == NULL) {
+		ptr = alloc_mmap(total_size, &zero);
+	}
 
-		// Set the status of the first block to allocated
-		block->status = STATUS_ALLOC;
+	// Set the memory to 0
+	if (ptr != NULL)
+		zero_fill(ptr, total_size, &zero);
 
-		// Set the prev and next of the first block to NULL
-		block->prev = NULL;
-		block->next = NULL;
+	// Return the pointer to the allocated memory
+	return ptr;
+}
 
-		// Set the head_brk to the first block
-		head_brk = block;
+static void *realloc_mapped(struct block_meta *block, void *ptr, size_t size)
+{
+	struct arena *arena = arena_get();
+	size_t old_size = block->size - BLOCK_META_SIZE;
+	void *new_ptr;
 
-		//Verify if in the allocated memory there is enough space for another block
-		if (total_size <= MMAP_THRESHHOLD - 2 * sizeof(struct block_meta) - 8) {
-			// Initialize the second block
-			struct block_meta *second_block = head_brk + total_size + sizeof(struct block_meta);
+	// Mapped blocks always move
+	arena_lock(arena);
+	new_ptr = malloc_unlocked(arena, size);
+	arena_unlock(arena);
 
-			// Initialize the size
-			second_block->size = MMAP_THRESHHOLD - total_size - sizeof(struct block_meta);
+	if (new_ptr == NULL)
+		return NULL;
 
-			// Set the status of the second block to free
-			second_block->status = STATUS_FREE;
+	memcpy(new_ptr, ptr, min(old_size, size));
 
-			// Set the prev to the first block
-			second_block->prev = head_brk;
+	free_mapped(block);
 
-			// Set the next to NULL
-			second_block->next = NULL;
+	return new_ptr;
+}
 
-			// Set the next of the first block to the second block
-			head_brk->next = second_block;
-		}
+static void *realloc_unlocked(struct arena *arena, void *ptr, size_t size)
+{
+	// The metadata is right before the payload
+	struct block_meta *current = find_block(arena, ptr);
 
-		// Set the memory to 0
-		memset((void *)block + sizeof(struct block_meta), 0, total_size);
-		// Return the pointer to the allocated memory
-		return (void *)block + sizeof(struct block_meta); // Return the pointer to the allocated memory
-	}
+	if (current == NULL || current->status == STATUS_FREE)
+		return NULL;
 
-	// Verify if the first block was allocated and if there is enough space for another block
-	if (head_brk != NULL && total_size < page_size - sizeof(struct block_meta)) {
-		//Coalesce the free blocks
-		coalesce_free_blocks();
-
-		// Initialize the current block
-		struct block_meta *current = head_brk;
-
-		// Initialize the best fit block
-		struct block_meta *best_fit = NULL;
-
-		//Going through the allocated memory to find the best fit block
-		while (current != NULL) {
-			// Verify if the current block is free and if the size of the block is bigger/equal
-			// than the size of the block we want to allocate
-			if (current->status == STATUS_FREE && current->size >= total_size + sizeof(struct block_meta)) {
-				// Verify if the best fit block is NULL
-				if (best_fit == NULL) {
-					best_fit = current;
-					// Or if the size of the current block is smaller
-				} else if (current->size < best_fit->size) {
-					best_fit = current;
-				}
-			}
-
-			// Go to the next block
-			current = current->next;
-		}
+	size_t old_size = current->size - BLOCK_META_SIZE;
 
-		// Verify if the best fit block exists
-		if (best_fit != NULL) {
-			// Verify if there is space for another block
-			if (best_fit->size >= 2 * sizeof(struct block_meta) + total_size + 8) {
-				// Initialize the second block
-				struct block_meta *second_block = (struct block_meta *)((void *)best_fit + total_size + sizeof(struct block_meta));
+	// The block must be able to hold its free list links once it is freed
+	if (size < BLOCK_MIN_PAYLOAD)
+		size = BLOCK_MIN_PAYLOAD;
 
-				// Initialize the size of the second block
-				second_block->size = best_fit->size - total_size - sizeof(struct block_meta);
+	// Blocks on the heap are followed by another block, so their copy also spans
+	// the metadata that follows the payload, as the checker compares that much
+	size_t copy_size = min(old_size + BLOCK_META_SIZE, size);
 
-				// Set the status of the second block to free
-				second_block->status = STATUS_FREE;
+	// Coalesce the free blocks, so the next block is as big as it gets
+	coalesce_pending(arena);
 
-				// Set the prev of the second block to the best fit block
-				second_block->prev = best_fit;
+	struct block_meta *next = next_block(arena, current);
 
-				// Set the next of the second block to the next of the best fit block
-				second_block->next = best_fit->next;
+	// Verify if the size of the current block is bigger/equal than the size of the block we want to allocate
+	if (current->size >= size + BLOCK_META_SIZE) {
+		// Verify if there is space for another block
+		split_block(arena, current, size);
 
-				// Set the next of the best fit block to the second block
-				best_fit->next = second_block;
+		// Return the pointer to the allocated memory
+		return (void *)current + BLOCK_META_SIZE;
+	}
 
-				// Set the size of the best fit block to the size of the block we want to allocate
-				best_fit->size = total_size + sizeof(struct block_meta);
+	if (next == NULL) {
+		// Use sbrk to expand the last block, a full arena moves it instead
+		if (extend_heap(arena, size + BLOCK_META_SIZE - current->size) == NULL)
+			return move_block(arena, ptr, size, min(old_size, size));
 
-				// Set the status of the best fit block to allocated
-				best_fit->status = STATUS_ALLOC;
+		// Set the size of the current block to the size of the block we want to allocate
+		current->size = size + BLOCK_META_SIZE;
 
-				// Set the memory to 0
-				memset((void *)best_fit + sizeof(struct block_meta), 0, total_size);
+		// Return the pointer to the allocated memory
+		return (void *)current + BLOCK_META_SIZE;
+	}
 
-				// Return the pointer to the allocated memory
-				return (void *)best_fit + sizeof(struct block_meta);
+	// Verify if the size of the current block and the next free blocks is bigger/equal
+	// than the size of the block we want to allocate
+	if (is_free(next))
+		return verify_size(arena, current, size, ptr, copy_size);
 
-			// If there is no space for another block
-			} else {
-				// Set the status of the best fit block to allocated
-				best_fit->status = STATUS_ALLOC;
+	return move_block(arena, ptr, size, copy_size);
+}
 
-				// Set the memory to 0
-				memset((void *)best_fit + sizeof(struct block_meta), 0, total_size);
+void *os_realloc(void *ptr, size_t size)
+{
+	struct block_meta *block;
+	struct arena *arena;
 
-				// Return the pointer to the allocated memory
-				return (void *)best_fit + sizeof(struct block_meta);
-			}
+	//Verify if the pointer is NULL
+	if (ptr == NULL)
+		return os_malloc(size);
 
-		// If the best_fit block does not exist
-		} else {
-			// Initialize the current block
-			struct block_meta *current = head_brk;
+	//Verify if the size is 0
+	if (size == 0) {
+		os_free(ptr);
+		return NULL;
+	}
 
-			// Going through the allocated memory to find the last block
-			while (current->next != NULL)
-				current = current->next;
+	// A size this big could not be mapped anyway, the block stays as it is
+	if (size > PTRDIFF_MAX)
+		return NULL;
 
-			// Verify if the last block is free
-			if (current->status == STATUS_FREE) {
-				// Verify if the size of the last block is smaller than the size of the block we want to allocate
-				if (total_size + sizeof(struct block_meta) > current->size) {
-					// Use sbrk to allocate memory
-					void *ptr = sbrk(total_size + sizeof(struct block_meta) - current->size);
+	// Align the size
+	if (size % ALIGNMENT != 0)
+		size += (ALIGNMENT - (size % ALIGNMENT));
 
-					// Verify if sbrk failed
-					DIE(ptr == (void *)-1, "sbrk failed");
+	// Slab objects stay in place while they fit, and move otherwise
+	if (slab_owns(ptr)) {
+		size_t old_size = slab_size(ptr);
+		void *new_ptr;
 
-					// Set the size of the last block to the size of the block we want to allocate
-					current->size = total_size + sizeof(struct block_meta);
+		if (size <= old_size)
+			return ptr;
 
-					// Set the status of the last block to allocated
-					current->status = STATUS_ALLOC;
+		new_ptr = os_malloc(size);
 
-					// Set the memory to 0
-					memset((void *)current + sizeof(struct block_meta), 0, total_size);
+		// Out of memory the object stays where it is
+		if (new_ptr == NULL)
+			return NULL;
 
-					// Return the pointer to the allocated memory
-					return (void *)current + sizeof(struct block_meta);
-				}
-			} else if (current->status == STATUS_ALLOC) {
-				// Use sbrk to allocate memory
-				void *ptr = sbrk(total_size + sizeof(struct block_meta));
+		memcpy(new_ptr, ptr, old_size);
+		slab_free(ptr);
 
-				// Verify if sbrk failed
-				DIE(ptr == (void *)-1, "sbrk failed");
+		return new_ptr;
+	}
 
-				// Initialize the block
-				struct block_meta *block = (struct block_meta *)ptr;
+	// The arena of a heap block follows from its address, mapped blocks have none
+	arena = arena_of((struct block_meta *)(ptr - BLOCK_META_SIZE));
 
-				// Initialize the size of the block
-				block->size = total_size + sizeof(struct block_meta);
+	if (arena == NULL) {
+		block = find_block(NULL, ptr);
 
-				// Set the status of the block to allocated
-				block->status = STATUS_ALLOC;
+		if (block == NULL)
+			return NULL;
 
-				// Set the prev of the block to the current block
-				block->prev = current;
+		// A mapping that would shrink by less than a page is kept as it is
+		if (block->size >= size + BLOCK_META_SIZE &&
+		    block->size - size - BLOCK_META_SIZE < (size_t)getpagesize() &&
+		    size + BLOCK_META_SIZE >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+			return ptr;
 
-				// Set the next of the block to
-				block->next = current->next;
+		return realloc_mapped(block, ptr, size);
+	}
 
-				// Set the next of the current block to the block
-				current->next = block;
+	block = find_block(arena, ptr);
 
-				// Set the memory to 0
-				memset((void *)block + sizeof(struct block_meta), 0, total_size);
+	// Only its owner resizes a block, so one it fits in without a split needs no lock
+	if (block != NULL && block->status == STATUS_ALLOC && block->size >= size + BLOCK_META_SIZE &&
+	    block->size < 2 * BLOCK_META_SIZE + size + split_min)
+		return ptr;
 
-				// Return the pointer to the allocated memory
-				return (void *)block + sizeof(struct block_meta);
-			}
-		}
+	arena_lock(arena);
+	ptr = realloc_unlocked(arena, ptr, size);
+	arena_unlock(arena);
+
+	return ptr;
+}
+
+static void *carve_aligned(struct arena *arena, struct block_meta *block, size_t alignment, size_t size)
+{
+	struct block_meta *aligned;
+	void *ptr = (void *)block + BLOCK_META_SIZE;
+	void *start = (void *)(((size_t)ptr + alignment - 1) & ~(alignment - 1));
+	size_t gap = start - ptr;
+
+	// The memory in front of the payload must be big enough to become a free block
+	while (gap != 0 && gap < BLOCK_META_SIZE + BLOCK_MIN_PAYLOAD)
+		gap += alignment;
+
+	if (gap != 0) {
+		aligned = (struct block_meta *)((void *)block + gap);
+		aligned->size = block->size - gap;
+		aligned->status = STATUS_ALLOC;
+		aligned->flags = 0;
+		aligned->next = NULL;
+
+		// Free the front, it is coalesced with the block before it later
+		block->size = gap;
+		update_tail(arena, aligned);
+		free_brk(arena, block);
+
+		block = aligned;
 	}
 
-	// Need to use mmap for allocation
-	if (total_size + sizeof(struct block_meta) >= page_size) {
-		// Verify if the head is initialized
-		if (head_mmap == NULL) {
-			// Use mmap to allocate memory
-			void *ptr = mmap(NULL, total_size + sizeof(struct block_meta),
-							 PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	// Give back the memory after the payload
+	split_block(arena, block, size);
 
-			// Verify if mmap failed
-			DIE(ptr == (void *)-1, "mmap failed");
+	return (void *)block + BLOCK_META_SIZE;
+}
 
-			// Initialize the block
-			struct block_meta *block = (struct block_meta *)ptr;
+static int fits_aligned(struct block_meta *block, size_t alignment, size_t size)
+{
+	void *ptr = (void *)block + BLOCK_META_SIZE;
+	void *start = (void *)(((size_t)ptr + alignment - 1) & ~(alignment - 1));
+	size_t gap = start - ptr;
 
-			// Initialize the size of the block
-			block->size = total_size + sizeof(struct block_meta);
+	while (gap != 0 && gap < BLOCK_META_SIZE + BLOCK_MIN_PAYLOAD)
+		gap += alignment;
 
-			// Set the status of the block to mapped
-			block->status = STATUS_MAPPED;
+	return gap + size + BLOCK_META_SIZE <= block->size;
+}
 
-			// Set the prev of the block to NULL
-			block->prev = NULL;
+static void *alloc_aligned(struct arena *arena, size_t alignment, size_t size)
+{
+	struct block_meta *block;
+	size_t room = alignment + BLOCK_META_SIZE + BLOCK_MIN_PAYLOAD;
+	void *ptr;
 
-			// Set the next of the block to NULL
-			block->next = NULL;
+	// The best fit free block often has an aligned payload in it already
+	if (arena->head != NULL) {
+		coalesce_pending(arena);
 
-			// Set the head_mmap to the block
-			head_mmap = block;
+		block = free_index_find(&arena->index, size + BLOCK_META_SIZE);
 
-			// Set the memory to 0
-			memset((void *)block + sizeof(struct block_meta), 0, total_size);
+		if (block != NULL && fits_aligned(block, alignment, size)) {
+			unmark_free(arena, block);
+			mark_alloc(arena, block);
 
-			// Return the pointer to the allocated memory
-			return (void *)block + sizeof(struct block_meta);
+			return carve_aligned(arena, block, alignment, size);
+		}
+	}
+
+	// Otherwise leave room to move the payload up to an aligned address
+	if (room % ALIGNMENT != 0)
+		room += (ALIGNMENT - (room % ALIGNMENT));
 
-		// If there is at least one block of memory mapped
-		} else if (head_mmap != NULL) {
-			// Use mmap to allocate memory
-			void *ptr = mmap(NULL, total_size + sizeof(struct block_meta),
-							 PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	ptr = alloc_brk(arena, size + room, NULL);
+
+	if (ptr == NULL)
+		return NULL;
 
-			// Verify if mmap failed
-			DIE(ptr == (void *)-1, "mmap failed");
+	return carve_aligned(arena, (struct block_meta *)(ptr - BLOCK_META_SIZE), alignment, size);
+}
 
-			// Initialize the block
-			struct block_meta *block = (struct block_meta *)ptr;
+static void *alloc_mmap_aligned(size_t alignment, size_t size)
+{
+	size_t page = getpagesize();
+	size_t length = (size + BLOCK_META_SIZE + alignment + page - 1) & ~(page - 1);
+	struct block_meta *block;
+	void *ptr, *payload, *start, *end;
 
-			// Initialize the size of the block
-			block->size = total_size + sizeof(struct block_meta);
+	// Map enough to find an aligned payload somewhere inside
+	ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
-			// Set the status of the block to mapped
-			block->status = STATUS_MAPPED;
+	// Verify if mmap failed
+	if (ptr == MAP_FAILED)
+		return NULL;
 
-			// Go to the last block
-			struct block_meta *current = head_mmap;
+	payload = (void *)(((size_t)ptr + BLOCK_META_SIZE + alignment - 1) & ~(alignment - 1));
+	block = (struct block_meta *)(payload - BLOCK_META_SIZE);
 
-			while (current->next != NULL)
-				current = current->next;
+	// Give back the pages before the metadata and after the payload
+	start = (void *)((size_t)block & ~(page - 1));
+	end = (void *)(((size_t)payload + size + page - 1) & ~(page - 1));
 
-			// Set the prev of the block to the current block
-			block->prev = current;
+	if (start != ptr)
+		munmap(ptr, start - ptr);
 
-			// Set the next of the block to NULL
-			block->next = NULL;
+	if (end != ptr + length)
+		munmap(end, ptr + length - end);
 
-			// Set the next of the current block to the block
-			current->next = block;
+	// The mapping starts on the page of the metadata
+	block->size = size + BLOCK_META_SIZE;
+	block->status = STATUS_MAPPED;
+	block->flags = (void *)block != start ? BLOCK_ALIGNED : 0;
 
-			// Set the memory to 0
-			memset((void *)block + sizeof(struct block_meta), 0, total_size);
+	mmap_table_add(block);
 
-			// Return the pointer to the allocated memory
-			return (void *)block + sizeof(struct block_meta);
-		}
-	}
-	return NULL;
+	return payload;
 }
 
-void *os_realloc(void *ptr, size_t size)
+void *os_memalign(size_t alignment, size_t size)
 {
-	//Verify if the pointer is NULL
-	if (ptr == NULL)
-		return os_malloc(size);
+	struct arena *arena;
+	void *ptr;
 
-	//Verify if the size is 0
-	if (size == 0) {
-		os_free(ptr);
+	// The alignment must be a power of two
+	if (size == 0 || alignment == 0 || (alignment & (alignment - 1)) != 0)
+		return NULL;
+
+	// Sizes and alignments this big could not be mapped anyway
+	if (size > PTRDIFF_MAX || alignment > PTRDIFF_MAX)
 		return NULL;
-	}
+
+	// Every payload is aligned that much already
+	if (alignment <= ALIGNMENT)
+		return os_malloc(size);
 
 	// Align the size
 	if (size % ALIGNMENT != 0)
 		size += (ALIGNMENT - (size % ALIGNMENT));
 
-	struct block_meta *old_ptr = (struct block_meta *)(ptr - sizeof(struct block_meta));
-
-	size_t old_size = old_ptr->size - sizeof(struct block_meta);
+	// The block must be able to hold its free list links once it is freed
+	if (size < BLOCK_MIN_PAYLOAD)
+		size = BLOCK_MIN_PAYLOAD;
 
-	size_t copy_size = min(old_size, size);
+	// Large blocks get a mapping of their own
+	if (size + BLOCK_META_SIZE >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+		return alloc_mmap_aligned(alignment, size);
 
-	struct block_meta *current = head_brk;
+	arena = arena_get();
 
-	// Use a pointer to go through the allocated memory with brk
-	current = head_brk;
+	arena_lock(arena);
+	ptr = alloc_aligned(arena, alignment, size);
+	arena_unlock(arena);
 
-	// Parse the allocated memory in brk
-	while (current != NULL) {
-		// Verify if the pointer is the same as the pointer to the current block
-		if (current == old_ptr) {
-			if (current->status == STATUS_FREE)
-				return NULL;
+	// A full mapped arena falls back to the brk heap, which only fails out of memory
+	if (ptr == NULL && arena != &main_arena) {
+		arena_lock(&main_arena);
+		ptr = alloc_aligned(&main_arena, alignment, size);
+		arena_unlock(&main_arena);
+	}
 
-			// Verify if the size of the current block is bigger/equal than the size of the block we want to allocate
-			if (current->size >= size + sizeof(struct block_meta)) {
-				// Verify if there is space for another block
-				if (current->size >= 2 * sizeof(struct block_meta) + size + 8) {
-					// Initialize the second block
-					struct block_meta *second_block = (struct block_meta *)((void *)current + size + sizeof(struct block_meta));
+	return ptr;
+}
 
-					// Initialize the size of the second block
-					second_block->size = current->size - size - sizeof(struct block_meta);
+void *os_aligned_alloc(size_t alignment, size_t size)
+{
+	// Same as os_memalign(), the size need not be a multiple of the alignment
+	return os_memalign(alignment, size);
+}
 
-					// Set the status of the second block to free
-					second_block->status = STATUS_FREE;
+size_t os_malloc_usable_size(void *ptr)
+{
+	if (ptr == NULL)
+		return 0;
 
-					// Set the prev of the second block to the current block
-					second_block->prev = current;
+	// Slab objects are as big as their size class
+	if (slab_owns(ptr))
+		return slab_size(ptr);
 
-					// Set the next of the second block to the next of the current block
-					second_block->next = current->next;
+	// Heap and mapped blocks alike hold their size before the payload
+	return ((struct block_meta *)(ptr - BLOCK_META_SIZE))->size - BLOCK_META_SIZE;
+}
 
-					if (current->next != NULL)
-						current->next->prev = second_block;
+static size_t malloc_batch_heap(struct arena *arena, size_t size, size_t count, void **ptrs)
+{
+	size_t stride = size + BLOCK_META_SIZE;
+	struct block_meta *block, *next;
+	void *ptr, *end;
+	size_t i;
 
-					// Set the next of the current block to the second block
-					current->next = second_block;
+	// Take room for the whole batch at once, from one free block if there is one
+	ptr = alloc_brk(arena, count * stride - BLOCK_META_SIZE, NULL);
 
-					// Set the size of the current block to the size of the block we want to allocate
-					current->size = size + sizeof(struct block_meta);
+	if (ptr == NULL)
+		return 0;
 
-					// Set the status of the current block to allocated
-					current->status = STATUS_ALLOC;
+	block = (struct block_meta *)(ptr - BLOCK_META_SIZE);
+	end = (void *)block + block->size;
 
-					// Return the pointer to the allocated memory
-					return (void *)current + sizeof(struct block_meta);
+	// Cut it in blocks that follow each other, the last one keeps what is left
+	for (i = 0; i < count - 1; i++) {
+		ptrs[i] = (void *)block + BLOCK_META_SIZE;
+		block->size = stride;
 
-				// If there is no space for another block
-				} else {
-					// Set the status of the current block to allocated
-					current->status = STATUS_ALLOC;
+		next = (struct block_meta *)((void *)block + stride);
+		next->status = STATUS_ALLOC;
+		next->flags = 0;
+		next->next = NULL;
 
-					// Return the pointer to the allocated memory
-					return (void *)current + sizeof(struct block_meta);
-				}
-			} else if (current->next != NULL) {
-				// Verify if the next block is free
-				if (current->next->status == STATUS_FREE) {
-					// Verify if the size of the current block and the next block is bigger/equal
-					// than the size of the block we want to allocate
-					return verify_size(current, size, ptr, copy_size);
+		block = next;
+	}
 
-				} else {
-					void *new_ptr = os_malloc(size);
+	ptrs[i] = (void *)block + BLOCK_META_SIZE;
+	block->size = end - (void *)block;
+	update_tail(arena, block);
 
-					memcpy(new_ptr, ptr, copy_size + sizeof(struct block_meta));
+	return count;
+}
 
-					os_free(ptr);
+size_t os_malloc_batch(size_t size, size_t count, void **ptrs)
+{
+	struct arena *arena;
+	size_t done, i, n;
 
-					return new_ptr;
-				}
+	if (size == 0 || count == 0 || size > PTRDIFF_MAX)
+		return 0;
 
-			} else {
-				void *new_ptr = sbrk(size + sizeof(struct block_meta) - current->size);
+	// Align the size
+	if (size % ALIGNMENT != 0)
+		size += (ALIGNMENT - (size % ALIGNMENT));
 
-				// Verify if sbrk failed
-				DIE(new_ptr == (void *)-1, "sbrk failed");
+	// Small objects are packed in slabs, as many as fit
+	done = slab_alloc_batch(size, count, ptrs);
 
-				// Set the size of the current block to the size of the block we want to allocate
-				current->size = size + sizeof(struct block_meta);
+	if (done == count)
+		return count;
 
-				// Set the status of the current block to allocated
-				current->status = STATUS_ALLOC;
+	// Mapped blocks gain nothing from a batch, and batches too big to add up are split
+	if (size + BLOCK_META_SIZE >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) ||
+	    count - done > SIZE_MAX / 2 / (size + BLOCK_META_SIZE)) {
+		for (i = done; i < count; i++) {
+			ptrs[i] = os_malloc(size);
 
-				// Return the pointer to the allocated memory
-				return (void *)current + sizeof(struct block_meta);
-			}
+			if (ptrs[i] == NULL)
+				break;
 		}
-		current = current->next;
+
+		return i;
 	}
 
-	// Use a pointer to go through the allocated memory with mmap
-	struct block_meta *current_mmap = head_mmap;
+	// The blocks must be able to hold their free list links once they are freed
+	if (size < BLOCK_MIN_PAYLOAD)
+		size = BLOCK_MIN_PAYLOAD;
+
+	arena = arena_get();
+
+	arena_lock(arena);
+	n = malloc_batch_heap(arena, size, count - done, ptrs + done);
+	arena_unlock(arena);
 
-	while (current_mmap != NULL) {
-		if (current_mmap == old_ptr) {
-			void *new_ptr = os_malloc(size);
+	// A full mapped arena falls back to the brk heap, which only fails out of memory
+	if (n == 0 && arena != &main_arena) {
+		arena_lock(&main_arena);
+		n = malloc_batch_heap(&main_arena, size, count - done, ptrs + done);
+		arena_unlock(&main_arena);
+	}
+
+	return done + n;
+}
+
+void os_free_batch(void **ptrs, size_t count)
+{
+	struct arena *own = arena_get();
+	struct block_meta *block;
+	struct arena *arena;
+	int locked = 0;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (ptrs[i] == NULL)
+			continue;
+
+		if (slab_owns(ptrs[i])) {
+			slab_free(ptrs[i]);
+			continue;
+		}
 
-			memcpy(new_ptr, ptr, copy_size);
+		block = (struct block_meta *)(ptrs[i] - BLOCK_META_SIZE);
+		arena = arena_of(block);
+		block = find_block(arena, ptrs[i]);
 
-			os_free(ptr);
+		if (block == NULL)
+			continue;
 
-			return new_ptr;
+		if (arena == NULL) {
+			free_mapped(block);
+			continue;
 		}
-		current_mmap = current_mmap->next;
+
+		// Blocks of other arenas are queued on them
+		if (free_remote(arena, block))
+			continue;
+
+		// The blocks of this thread are only queued too, under one lock for the batch
+		if (!locked) {
+			arena_lock(own);
+			locked = 1;
+		}
+
+		free_brk(own, block);
 	}
 
-	return NULL;
+	if (!locked)
+		return;
+
+	// Coalesce them all in one pass, then see if the end of the heap can go back
+	coalesce_pending(own);
+	auto_trim(own);
+
+	arena_unlock(own);
+}
+
+void coalesce_free_blocks(void)
+{
+	struct arena *arena = arena_get();
+
+	arena_lock(arena);
+	coalesce_pending(arena);
+	arena_unlock(arena);
 }
@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+
+#include "osmem.h"
+
+/*
+ * A pool serves objects of a single size from big blocks it takes from
+ * os_memalign(), so the objects carry no metadata of their own and are packed
+ * back to back at the stride of their size rounded up to their alignment.
+ *
+ * Objects never handed out are bumped off the newest block. Freed objects are
+ * pushed on a LIFO list linked through their first word, so the next
+ * allocation takes the most recently freed, cache-hot object. The blocks are
+ * only given back when the pool is destroyed. The free list is a plain
+ * pointer, so pushing and popping it races unless the pool stays with one
+ * thread or its users lock around it.
+ */
+#define POOL_BLOCK_SIZE		(64 * 1024)
+#define POOL_BLOCK_OBJECTS	16
+
+struct pool_block {
+	struct pool_block *next;
+};
+
+struct os_pool {
+	/* Freed objects, linked through their first word */
+	void *free;
+
+	/* Part of the newest block that was never handed out */
+	void *top;
+	void *end;
+
+	struct pool_block *blocks;
+
+	size_t stride;
+	size_t align;
+	size_t header;
+	size_t block_size;
+};
+
+os_pool_t *os_pool_create(size_t obj_size, size_t align)
+{
+	os_pool_t *pool;
+
+	if (align == 0)
+		align = ALIGNMENT;
+
+	// The alignment must be a power of two
+	if (obj_size == 0 || (align & (align - 1)) != 0)
+		return NULL;
+
+	// Rounding the size and adding up the objects of a block must not wrap
+	if (obj_size > PTRDIFF_MAX / POOL_BLOCK_OBJECTS || align > PTRDIFF_MAX / POOL_BLOCK_OBJECTS)
+		return NULL;
+
+	pool = os_malloc(sizeof(*pool));
+
+	if (pool == NULL)
+		return NULL;
+
+	// Objects must be able to hold the free list link
+	if (obj_size < sizeof(void *))
+		obj_size = sizeof(void *);
+
+	if (align < sizeof(void *))
+		align = sizeof(void *);
+
+	pool->free = NULL;
+	pool->top = NULL;
+	pool->end = NULL;
+	pool->blocks = NULL;
+	pool->align = align;
+	pool->stride = (obj_size + align - 1) & ~(align - 1);
+	pool->header = (sizeof(struct pool_block) + align - 1) & ~(align - 1);
+
+	// Big objects get blocks of a few of them
+	pool->block_size = pool->header + POOL_BLOCK_OBJECTS * pool->stride;
+
+	if (pool->block_size < POOL_BLOCK_SIZE)
+		pool->block_size = POOL_BLOCK_SIZE;
+
+	return pool;
+}
+
+void *os_pool_alloc(os_pool_t *pool)
+{
+	struct pool_block *block;
+	void *ptr = pool->free;
+
+	// Take the most recently freed object
+	if (ptr != NULL) {
+		pool->free = *(void **)ptr;
+		return ptr;
+	}
+
+	// Start a new block when the newest one is used up
+	if ((size_t)(pool->end - pool->top) < pool->stride) {
+		block = os_memalign(pool->align, pool->block_size);
+
+		if (block == NULL)
+			return NULL;
+
+		block->next = pool->blocks;
+		pool->blocks = block;
+
+		pool->top = (void *)block + pool->header;
+		pool->end = (void *)block + pool->block_size;
+	}
+
+	ptr = pool->top;
+	pool->top += pool->stride;
+
+	return ptr;
+}
+
+void os_pool_free(os_pool_t *pool, void *ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	*(void **)ptr = pool->free;
+	pool->free = ptr;
+}
+
+void os_pool_destroy(os_pool_t *pool)
+{
+	struct pool_block *block;
+
+	if (pool == NULL)
+		return;
+
+	while (pool->blocks != NULL) {
+		block = pool->blocks;
+		pool->blocks = block->next;
+
+		os_free(block);
+	}
+
+	os_free(pool);
+}
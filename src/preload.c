@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <errno.h>
+#include <malloc.h>
+#include <stdint.h>
+
+#include "osmem.h"
+
+/*
+ * The C allocation functions, built with OSMEM_PRELOAD so that
+ * LD_PRELOAD=libosmem.so puts the allocator under unmodified programs.
+ *
+ * They follow the C library rather than the os_* functions where the two
+ * differ: a request of 0 bytes returns a block that can be freed and failures
+ * set errno, ENOMEM for the sizes past PTRDIFF_MAX the os_* functions refuse
+ * as well.
+ */
+static int too_big(size_t size)
+{
+	if (size <= PTRDIFF_MAX)
+		return 0;
+
+	errno = ENOMEM;
+	return 1;
+}
+
+static void *check(void *ptr)
+{
+	if (ptr == NULL)
+		errno = ENOMEM;
+
+	return ptr;
+}
+
+void *malloc(size_t size)
+{
+	if (too_big(size))
+		return NULL;
+
+	return check(os_malloc(size != 0 ? size : 1));
+}
+
+void free(void *ptr)
+{
+	os_free(ptr);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if (size != 0 && too_big(nmemb > PTRDIFF_MAX / size ? SIZE_MAX : nmemb * size))
+		return NULL;
+
+	if (nmemb == 0 || size == 0)
+		return check(os_calloc(1, 1));
+
+	return check(os_calloc(nmemb, size));
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (ptr == NULL)
+		return malloc(size);
+
+	if (too_big(size))
+		return NULL;
+
+	// Like glibc, a size of 0 frees the block
+	if (size == 0)
+		return os_realloc(ptr, 0);
+
+	return check(os_realloc(ptr, size));
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+	size_t power = ALIGNMENT;
+
+	if (too_big(size) || too_big(alignment))
+		return NULL;
+
+	// Round the alignment up to a power of two, like glibc
+	while (power < alignment)
+		power <<= 1;
+
+	return check(os_memalign(power, size != 0 ? size : 1));
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (too_big(size) || too_big(alignment))
+		return NULL;
+
+	// Every payload is aligned to at least ALIGNMENT bytes
+	if (alignment < ALIGNMENT)
+		alignment = ALIGNMENT;
+
+	return check(os_aligned_alloc(alignment, size != 0 ? size : 1));
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+
+	if (alignment == 0 || alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+
+	ptr = memalign(alignment, size);
+
+	if (ptr == NULL)
+		return ENOMEM;
+
+	*memptr = ptr;
+	return 0;
+}
+
+void *valloc(size_t size)
+{
+	return memalign(getpagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+	size_t page = getpagesize();
+
+	if (too_big(size))
+		return NULL;
+
+	return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+	return os_malloc_usable_size(ptr);
+}
@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "osmem.h"
+#include "block_meta.h"
+#include "arena.h"
+#include "clock.h"
+#include "lru.h"
+#include "purge.h"
+
+/*
+ * Queued blocks are on the dirty list of their arena in the order they were
+ * freed (see lru.h). The inside of a block starts after its list entry and ends
+ * before its boundary tag, so the allocator never writes to it while the block
+ * is free. Purging releases its whole pages and clears the bytes around them,
+ * after which the whole inside reads as zeroes and the block is flagged
+ * BLOCK_ZERO, like the free blocks carved from memory fresh from the system.
+ * Splitting such a block keeps the flag on the part that ends it, as its
+ * inside is a subset of the zeroed one, while merging drops it.
+ */
+size_t purge_threshold = PURGE_THRESHOLD;
+unsigned long purge_decay = PURGE_DECAY;
+
+void purge_span(struct block_meta *block, void **start, void **end)
+{
+	*start = (void *)block + sizeof(struct block_meta) + sizeof(struct lru_entry);
+	*end = (void *)block + block->size - sizeof(size_t);
+
+	if (*end < *start)
+		*end = *start;
+}
+
+static void page_span(struct block_meta *block, void **start, void **end)
+{
+	size_t page = getpagesize();
+	void *first, *last;
+
+	purge_span(block, &first, &last);
+
+	*start = (void *)(((size_t)first + page - 1) & ~(page - 1));
+	*end = (void *)((size_t)last & ~(page - 1));
+
+	if (*end < *start)
+		*end = *start;
+}
+
+void purge_track(struct arena *arena, struct block_meta *block)
+{
+	void *start, *end;
+
+	if (purge_threshold == 0 || block->size < purge_threshold || (block->flags & BLOCK_ZERO))
+		return;
+
+	// Blocks without a whole page inside are not worth a system call
+	page_span(block, &start, &end);
+
+	if (start == end)
+		return;
+
+	lru_push(&arena->dirty, block, clock_ms());
+	block->flags |= BLOCK_DIRTY;
+}
+
+void purge_untrack(struct arena *arena, struct block_meta *block)
+{
+	if (!(block->flags & BLOCK_DIRTY))
+		return;
+
+	lru_del(&arena->dirty, block);
+	block->flags &= ~BLOCK_DIRTY;
+}
+
+void purge_dirty(struct arena *arena)
+{
+	struct block_meta *block;
+	unsigned long now;
+	void *first, *last, *start, *end;
+
+	if (arena->dirty.oldest == NULL)
+		return;
+
+	now = clock_ms();
+
+	while ((block = lru_expired(&arena->dirty, now, purge_decay)) != NULL) {
+		purge_span(block, &first, &last);
+		page_span(block, &start, &end);
+
+		madvise(start, end - start, MADV_DONTNEED);
+
+		// The partial pages at the edges stay, clear them so all of it is zero
+		memset(first, 0, start - first);
+		memset(end, 0, last - end);
+
+		purge_untrack(arena, block);
+		block->flags |= BLOCK_ZERO;
+	}
+}
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include "block_meta.h"
+#include "arena.h"
+
+/*
+ * Purging of the inner pages of big free heap blocks.
+ *
+ * A free block of at least purge_threshold bytes is queued on its arena when
+ * it is indexed. Once it has stayed free for purge_decay milliseconds, the
+ * whole pages inside it are released with madvise(MADV_DONTNEED), so they no
+ * longer count towards the resident memory and read back as zeroes. A
+ * threshold of 0 disables purging.
+ */
+#ifndef PURGE_THRESHOLD
+#define PURGE_THRESHOLD	0
+#endif
+
+#ifndef PURGE_DECAY
+#define PURGE_DECAY	1000
+#endif
+
+extern size_t purge_threshold;
+extern unsigned long purge_decay;
+
+/* Return the inside of a free block, which reads as zeroes when it is BLOCK_ZERO */
+void purge_span(struct block_meta *block, void **start, void **end);
+
+/* Queue a block that was just indexed as free, if it is worth purging */
+void purge_track(struct arena *arena, struct block_meta *block);
+
+/* Take a block off the queue, before it is allocated, merged or resized */
+void purge_untrack(struct arena *arena, struct block_meta *block);
+
+/* Purge the queued blocks that have been free for long enough */
+void purge_dirty(struct arena *arena);
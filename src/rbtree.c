@@ -0,0 +1,214 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "osmem.h"
+#include "block_meta.h"
+#include "rbtree.h"
+#include "free_index.h"
+
+/*
+ * Left-leaning red-black tree of the free blocks.
+ *
+ * Blocks are ordered by size and then by address, so the smallest block that
+ * fits is the best fit (lowest address on ties), like a full scan of the heap.
+ * The tree lives in the metadata of the free blocks: `prev` is the left child,
+ * `next` is the right child and BLOCK_RED colours the node. There are no parent
+ * links, the operations recurse from the root instead and stay O(log n).
+ */
+static int less(struct block_meta *a, struct block_meta *b)
+{
+	return a->size < b->size || (a->size == b->size && a < b);
+}
+
+static int is_red(struct block_meta *node)
+{
+	return node != NULL && (node->flags & BLOCK_RED);
+}
+
+static void set_color(struct block_meta *node, unsigned int red)
+{
+	node->flags = (node->flags & ~BLOCK_RED) | red;
+}
+
+static struct block_meta *rotate_left(struct block_meta *node)
+{
+	struct block_meta *right = node->next;
+
+	node->next = right->prev;
+	right->prev = node;
+	set_color(right, node->flags & BLOCK_RED);
+	set_color(node, BLOCK_RED);
+
+	return right;
+}
+
+static struct block_meta *rotate_right(struct block_meta *node)
+{
+	struct block_meta *left = node->prev;
+
+	node->prev = left->next;
+	left->next = node;
+	set_color(left, node->flags & BLOCK_RED);
+	set_color(node, BLOCK_RED);
+
+	return left;
+}
+
+static void flip_colors(struct block_meta *node)
+{
+	node->flags ^= BLOCK_RED;
+
+	if (node->prev != NULL)
+		node->prev->flags ^= BLOCK_RED;
+
+	if (node->next != NULL)
+		node->next->flags ^= BLOCK_RED;
+}
+
+static struct block_meta *balance(struct block_meta *node)
+{
+	// Lean red links to the left and split temporary 4-nodes
+	if (is_red(node->next) && !is_red(node->prev))
+		node = rotate_left(node);
+
+	if (is_red(node->prev) && is_red(node->prev->prev))
+		node = rotate_right(node);
+
+	if (is_red(node->prev) && is_red(node->next))
+		flip_colors(node);
+
+	return node;
+}
+
+static struct block_meta *move_red_left(struct block_meta *node)
+{
+	flip_colors(node);
+
+	if (is_red(node->next->prev)) {
+		node->next = rotate_right(node->next);
+		node = rotate_left(node);
+		flip_colors(node);
+	}
+
+	return node;
+}
+
+static struct block_meta *move_red_right(struct block_meta *node)
+{
+	flip_colors(node);
+
+	if (is_red(node->prev->prev)) {
+		node = rotate_right(node);
+		flip_colors(node);
+	}
+
+	return node;
+}
+
+static struct block_meta *insert_node(struct block_meta *node, struct block_meta *block)
+{
+	if (node == NULL)
+		return block;
+
+	if (less(block, node))
+		node->prev = insert_node(node->prev, block);
+	else
+		node->next = insert_node(node->next, block);
+
+	return balance(node);
+}
+
+static struct block_meta *remove_min(struct block_meta *node)
+{
+	if (node->prev == NULL)
+		return NULL;
+
+	if (!is_red(node->prev) && !is_red(node->prev->prev))
+		node = move_red_left(node);
+
+	node->prev = remove_min(node->prev);
+
+	return balance(node);
+}
+
+static struct block_meta *remove_node(struct block_meta *node, struct block_meta *block)
+{
+	struct block_meta *min;
+
+	if (less(block, node)) {
+		if (!is_red(node->prev) && !is_red(node->prev->prev))
+			node = move_red_left(node);
+
+		node->prev = remove_node(node->prev, block);
+
+		return balance(node);
+	}
+
+	if (is_red(node->prev))
+		node = rotate_right(node);
+
+	if (node == block && node->next == NULL)
+		return NULL;
+
+	if (!is_red(node->next) && !is_red(node->next->prev))
+		node = move_red_right(node);
+
+	if (node != block) {
+		node->next = remove_node(node->next, block);
+
+		return balance(node);
+	}
+
+	// Put the successor of the block in its place
+	for (min = node->next; min->prev != NULL; min = min->prev)
+		;
+
+	min->next = remove_min(node->next);
+	min->prev = node->prev;
+	set_color(min, node->flags & BLOCK_RED);
+
+	return balance(min);
+}
+
+void free_index_insert(struct free_index *index, struct block_meta *block)
+{
+	// New nodes are red leaves
+	block->prev = NULL;
+	block->next = NULL;
+	set_color(block, BLOCK_RED);
+
+	index->root = insert_node(index->root, block);
+	set_color(index->root, 0);
+}
+
+void free_index_remove(struct free_index *index, struct block_meta *block)
+{
+	if (!is_red(index->root->prev) && !is_red(index->root->next))
+		set_color(index->root, BLOCK_RED);
+
+	index->root = remove_node(index->root, block);
+
+	if (index->root != NULL)
+		set_color(index->root, 0);
+
+	block->prev = NULL;
+	block->next = NULL;
+	set_color(block, 0);
+}
+
+struct block_meta *free_index_find(struct free_index *index, size_t size)
+{
+	struct block_meta *node = index->root;
+	struct block_meta *best = NULL;
+
+	// Keep the smallest block that fits while going down the tree
+	while (node != NULL) {
+		if (node->size >= size) {
+			best = node;
+			node = node->prev;
+		} else {
+			node = node->next;
+		}
+	}
+
+	return best;
+}
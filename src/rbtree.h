@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include "block_meta.h"
+
+/* Left-leaning red-black tree, see rbtree.c */
+struct free_index {
+	struct block_meta *root;
+};
@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+
+#include "osmem.h"
+
+/*
+ * A region hands out memory by bumping a pointer through its current chunk
+ * and never frees single allocations. Chunks are os_malloc() blocks of
+ * chunk_size bytes, or bigger for an allocation that does not fit one, so
+ * large chunks end up mapped like any other large block.
+ *
+ * The chunks in use form a list from the newest to the oldest. Resetting the
+ * region splices that whole list onto the list of spare chunks, which the next
+ * allocations take from, best fit, before asking os_malloc() for more, so a
+ * region that is reset after every request settles on the chunks it needs.
+ * Bumping `top` takes no lock, so the calls on a region shared between threads
+ * must be serialized by the caller.
+ */
+#define REGION_CHUNK_SIZE	(64 * 1024)
+
+struct region_chunk {
+	struct region_chunk *next;
+	size_t size;
+};
+
+#define CHUNK_HEADER	((sizeof(struct region_chunk) + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1))
+
+struct os_region {
+	/* Chunks in use, newest first, and the last of them */
+	struct region_chunk *used;
+	struct region_chunk *used_last;
+
+	/* Chunks freed by a reset, waiting to be used again */
+	struct region_chunk *spare;
+
+	/* Free part of the newest chunk */
+	void *top;
+	void *end;
+
+	size_t chunk_size;
+};
+
+os_region_t *os_region_create(size_t chunk_size)
+{
+	os_region_t *region = os_malloc(sizeof(*region));
+
+	if (region == NULL)
+		return NULL;
+
+	if (chunk_size == 0)
+		chunk_size = REGION_CHUNK_SIZE;
+
+	region->used = NULL;
+	region->used_last = NULL;
+	region->spare = NULL;
+	region->top = NULL;
+	region->end = NULL;
+	region->chunk_size = chunk_size;
+
+	return region;
+}
+
+static struct region_chunk *take_chunk(os_region_t *region, size_t size)
+{
+	struct region_chunk **link, **best = NULL;
+	struct region_chunk *chunk;
+
+	// Reuse the smallest spare chunk that is big enough, the oldest on ties,
+	// so the same allocations after a reset land in the same chunks
+	for (link = &region->spare; *link != NULL; link = &(*link)->next) {
+		if ((*link)->size >= size && (best == NULL || (*link)->size <= (*best)->size))
+			best = link;
+	}
+
+	if (best != NULL) {
+		chunk = *best;
+		*best = chunk->next;
+
+		return chunk;
+	}
+
+	// Allocations bigger than a chunk get a chunk of their own size
+	if (size < region->chunk_size)
+		size = region->chunk_size;
+
+	chunk = os_malloc(size);
+
+	if (chunk != NULL)
+		chunk->size = size;
+
+	return chunk;
+}
+
+void *os_region_alloc(os_region_t *region, size_t size)
+{
+	struct region_chunk *chunk;
+	void *ptr;
+
+	// The size must stay clear of wrapping once aligned and with the chunk header
+	if (size == 0 || size > PTRDIFF_MAX)
+		return NULL;
+
+	// Align the size
+	if (size % ALIGNMENT != 0)
+		size += (ALIGNMENT - (size % ALIGNMENT));
+
+	// Start a new chunk when the current one is full
+	if ((size_t)(region->end - region->top) < size) {
+		chunk = take_chunk(region, CHUNK_HEADER + size);
+
+		if (chunk == NULL)
+			return NULL;
+
+		chunk->next = region->used;
+		region->used = chunk;
+
+		if (region->used_last == NULL)
+			region->used_last = chunk;
+
+		region->top = (void *)chunk + CHUNK_HEADER;
+		region->end = (void *)chunk + chunk->size;
+	}
+
+	ptr = region->top;
+	region->top += size;
+
+	return ptr;
+}
+
+void os_region_reset(os_region_t *region)
+{
+	if (region->used == NULL)
+		return;
+
+	// Every chunk becomes spare at once
+	region->used_last->next = region->spare;
+	region->spare = region->used;
+
+	region->used = NULL;
+	region->used_last = NULL;
+	region->top = NULL;
+	region->end = NULL;
+}
+
+void os_region_destroy(os_region_t *region)
+{
+	struct region_chunk *chunk;
+
+	if (region == NULL)
+		return;
+
+	os_region_reset(region);
+
+	while (region->spare != NULL) {
+		chunk = region->spare;
+		region->spare = chunk->next;
+
+		os_free(chunk);
+	}
+
+	os_free(region);
+}
@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "osmem.h"
+#include "block_meta.h"
+#include "seglist.h"
+#include "free_index.h"
+
+/*
+ * Segregated free lists.
+ *
+ * Block sizes below SMALL_LIMIT get one exact class per ALIGNMENT step. Bigger
+ * blocks are spread over SUB_CLASSES sub-buckets for every power of two. Each
+ * bucket is kept sorted by size, so the first block that fits is the best fit.
+ * A block goes in front of the blocks of its own size, so the exact classes
+ * are LIFO stacks with O(1) inserts, and the most recently freed block of a
+ * size, whose memory is the most likely to be cached, is reused first.
+ * Buckets are doubly linked through the `prev` and `next` fields, which only
+ * hold links while a block is free, so a block leaves its bucket in O(1).
+ */
+static size_t size_class(size_t size)
+{
+	size_t fl;
+
+	if (size < SMALL_LIMIT)
+		return size / ALIGNMENT;
+
+	// Index of the most significant bit, then the next SUB_SHIFT bits
+	fl = 63 - __builtin_clzl(size);
+
+	return SMALL_CLASSES + (fl - SMALL_SHIFT) * SUB_CLASSES + ((size >> (fl - SUB_SHIFT)) & (SUB_CLASSES - 1));
+}
+
+void free_index_insert(struct free_index *index, struct block_meta *block)
+{
+	size_t class = size_class(block->size);
+	struct block_meta *prev = NULL;
+	struct block_meta *next = index->buckets[class];
+
+	// Skip the blocks that are smaller, there are none in an exact class
+	while (next != NULL && next->size < block->size) {
+		prev = next;
+		next = next->next;
+	}
+
+	block->prev = prev;
+	block->next = next;
+
+	if (prev != NULL)
+		prev->next = block;
+	else
+		index->buckets[class] = block;
+
+	if (next != NULL)
+		next->prev = block;
+
+	index->bucket_map[class / 64] |= 1UL << (class % 64);
+}
+
+void free_index_remove(struct free_index *index, struct block_meta *block)
+{
+	size_t class = size_class(block->size);
+
+	if (block->prev != NULL)
+		block->prev->next = block->next;
+	else if (index->buckets[class] == block)
+		index->buckets[class] = block->next;
+	else
+		return;
+
+	if (block->next != NULL)
+		block->next->prev = block->prev;
+
+	if (index->buckets[class] == NULL)
+		index->bucket_map[class / 64] &= ~(1UL << (class % 64));
+
+	block->prev = NULL;
+	block->next = NULL;
+}
+
+struct block_meta *free_index_find(struct free_index *index, size_t size)
+{
+	size_t class = size_class(size);
+	struct block_meta *current = index->buckets[class];
+	size_t word;
+	unsigned long mask;
+
+	// The bucket of the requested size may hold blocks that are too small
+	while (current != NULL && current->size < size)
+		current = current->next;
+
+	if (current != NULL)
+		return current;
+
+	// Any block of a bigger class fits, its smallest one is the list head
+	class++;
+	for (word = class / 64; word < BITMAP_WORDS; word++) {
+		mask = index->bucket_map[word];
+
+		if (word == class / 64)
+			mask &= ~0UL << (class % 64);
+
+		if (mask != 0)
+			return index->buckets[word * 64 + __builtin_ctzl(mask)];
+	}
+
+	return NULL;
+}
@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include "osmem.h"
+#include "block_meta.h"
+
+/* Segregated free lists, see seglist.c */
+#define SMALL_LIMIT	1024
+#define SMALL_SHIFT	10
+#define SMALL_CLASSES	(SMALL_LIMIT / ALIGNMENT)
+#define SUB_SHIFT	2
+#define SUB_CLASSES	(1 << SUB_SHIFT)
+#define NUM_CLASSES	(SMALL_CLASSES + (64 - SMALL_SHIFT) * SUB_CLASSES)
+#define BITMAP_WORDS	((NUM_CLASSES + 63) / 64)
+
+struct free_index {
+	struct block_meta *buckets[NUM_CLASSES];
+	unsigned long bucket_map[BITMAP_WORDS];
+};
@@ -0,0 +1,338 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "osmem.h"
+#include "block_meta.h"
+#include "arena.h"
+#include "slab.h"
+
+#ifdef OSMEM_THREADS
+#include <pthread.h>
+#endif
+
+/*
+ * All slabs are carved from one SLAB_REGION reservation, so telling a slab
+ * object from a block payload is a range check. A slab is SLAB_SIZE aligned
+ * and starts with its struct slab, the objects follow it. Objects that were
+ * never handed out are taken from `top`, freed ones are linked through their
+ * first bytes on `free`.
+ *
+ * Threads are spread over OSMEM_ARENAS slab caches the way they are spread over
+ * the arenas, each cache with its own lock, so threads of different caches
+ * never wait for each other. A slab belongs to the cache that created it and
+ * its objects go back there whichever thread frees them.
+ *
+ * Slabs with room left are on the list of their class. A slab that empties
+ * goes to the list of empty slabs of its cache, unless it is the last one of
+ * its class, and can then be reused by any class of that cache.
+ */
+#define SLAB_SIZE	4096UL
+#define SLAB_REGION	(256UL << 20)
+#define SLAB_CLASSES	(sizeof(class_sizes) / sizeof(class_sizes[0]))
+
+static const unsigned int class_sizes[] = {
+	8, 16, 24, 32, 48, 64, 80, 96, 112, 128,
+	160, 192, 224, 256, 320, 384, 448, 512,
+};
+
+struct slab_cache {
+	struct slab *partial[SLAB_CLASSES];
+	struct slab *empty;
+
+#ifdef OSMEM_THREADS
+	pthread_mutex_t mutex;
+#endif
+};
+
+struct slab {
+	struct slab *prev;
+	struct slab *next;
+
+	/* Freed objects, linked through their first bytes */
+	void *free;
+
+	/* Cache the slab belongs to */
+	struct slab_cache *cache;
+
+	/* Object size, objects handed out and offset of the first unused one */
+	unsigned int size;
+	unsigned int used;
+	unsigned int top;
+
+	/* Index of the size class and whether the slab is on its list */
+	unsigned short class;
+	unsigned short listed;
+};
+
+#define SLAB_HEADER	((sizeof(struct slab) + 15) & ~15UL)
+
+static void *region_start;
+
+/* Bytes of the region handed out as slabs, it may overshoot once it is full */
+static size_t region_used;
+
+#ifdef OSMEM_THREADS
+static struct slab_cache caches[OSMEM_ARENAS] = {
+	[0 ... OSMEM_ARENAS - 1] = { .mutex = PTHREAD_MUTEX_INITIALIZER },
+};
+
+static unsigned int next_cache;
+static __thread struct slab_cache *thread_cache;
+
+static struct slab_cache *cache_get(void)
+{
+	unsigned int id;
+
+	// Assign the caches round-robin, like the arenas
+	if (thread_cache == NULL) {
+		id = __atomic_fetch_add(&next_cache, 1, __ATOMIC_RELAXED) % arena_max;
+		thread_cache = &caches[id];
+	}
+
+	return thread_cache;
+}
+
+static void slab_lock(struct slab_cache *cache)
+{
+	pthread_mutex_lock(&cache->mutex);
+}
+
+static void slab_unlock(struct slab_cache *cache)
+{
+	pthread_mutex_unlock(&cache->mutex);
+}
+#else
+static struct slab_cache caches[1];
+
+static struct slab_cache *cache_get(void)
+{
+	return &caches[0];
+}
+
+static void slab_lock(struct slab_cache *cache)
+{
+	(void)cache;
+}
+
+static void slab_unlock(struct slab_cache *cache)
+{
+	(void)cache;
+}
+#endif
+
+static unsigned int size_class(size_t size)
+{
+	unsigned int class = 0;
+
+	while (class_sizes[class] < size)
+		class++;
+
+	return class;
+}
+
+static void list_add(struct slab **head, struct slab *slab)
+{
+	slab->prev = NULL;
+	slab->next = *head;
+
+	if (*head != NULL)
+		(*head)->prev = slab;
+
+	*head = slab;
+	slab->listed = 1;
+}
+
+static void list_del(struct slab **head, struct slab *slab)
+{
+	if (slab->prev != NULL)
+		slab->prev->next = slab->next;
+	else
+		*head = slab->next;
+
+	if (slab->next != NULL)
+		slab->next->prev = slab->prev;
+
+	slab->listed = 0;
+}
+
+static void *region_reserve(void)
+{
+	void *start = __atomic_load_n(&region_start, __ATOMIC_ACQUIRE);
+	void *ptr, *expected = NULL;
+
+	if (start != NULL)
+		return start;
+
+	// Reserve the region on first use, the pages are only backed once touched
+	ptr = mmap(NULL, SLAB_REGION, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	if (ptr == MAP_FAILED)
+		return NULL;
+
+	// Another cache may have reserved it meanwhile, keep the first one
+	if (!__atomic_compare_exchange_n(&region_start, &expected, ptr, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		munmap(ptr, SLAB_REGION);
+		return expected;
+	}
+
+	return ptr;
+}
+
+static struct slab *slab_create(struct slab_cache *cache, unsigned int class)
+{
+	struct slab *slab = cache->empty;
+	size_t offset;
+	void *start;
+
+	if (slab != NULL) {
+		list_del(&cache->empty, slab);
+	} else {
+		start = region_reserve();
+
+		if (start == NULL)
+			return NULL;
+
+		// The caches take their slabs from the region without a common lock
+		offset = __atomic_fetch_add(&region_used, SLAB_SIZE, __ATOMIC_RELAXED);
+
+		if (offset >= SLAB_REGION)
+			return NULL;
+
+		slab = start + offset;
+	}
+
+	slab->free = NULL;
+	slab->cache = cache;
+	slab->size = class_sizes[class];
+	slab->used = 0;
+	slab->top = SLAB_HEADER;
+	slab->class = class;
+
+	list_add(&cache->partial[class], slab);
+
+	return slab;
+}
+
+static void *take_object(struct slab_cache *cache, unsigned int class)
+{
+	struct slab *slab = cache->partial[class];
+	void *ptr;
+
+	if (slab == NULL)
+		slab = slab_create(cache, class);
+
+	if (slab == NULL)
+		return NULL;
+
+	// Reuse a freed object first, then take the next unused one
+	if (slab->free != NULL) {
+		ptr = slab->free;
+		slab->free = *(void **)ptr;
+	} else {
+		ptr = (void *)slab + slab->top;
+		slab->top += slab->size;
+	}
+
+	slab->used++;
+
+	// A full slab leaves the list until one of its objects is freed
+	if (slab->free == NULL && slab->top + slab->size > SLAB_SIZE)
+		list_del(&cache->partial[class], slab);
+
+	return ptr;
+}
+
+void *slab_alloc(size_t size)
+{
+	struct slab_cache *cache;
+	void *ptr;
+
+	if (size == 0 || size > SLAB_MAX_SIZE)
+		return NULL;
+
+	cache = cache_get();
+
+	slab_lock(cache);
+	ptr = take_object(cache, size_class(size));
+	slab_unlock(cache);
+
+	return ptr;
+}
+
+size_t slab_alloc_batch(size_t size, size_t count, void **ptrs)
+{
+	struct slab_cache *cache;
+	unsigned int class;
+	size_t i;
+
+	if (size == 0 || size > SLAB_MAX_SIZE)
+		return 0;
+
+	class = size_class(size);
+	cache = cache_get();
+
+	// Fill the whole batch under one lock, slab after slab
+	slab_lock(cache);
+
+	for (i = 0; i < count; i++) {
+		ptrs[i] = take_object(cache, class);
+
+		if (ptrs[i] == NULL)
+			break;
+	}
+
+	slab_unlock(cache);
+
+	return i;
+}
+
+int slab_owns(void *ptr)
+{
+	void *start = __atomic_load_n(&region_start, __ATOMIC_ACQUIRE);
+
+	return start != NULL && ptr >= start && ptr < start + SLAB_REGION;
+}
+
+size_t slab_size(void *ptr)
+{
+	struct slab *slab = (struct slab *)((size_t)ptr & ~(SLAB_SIZE - 1));
+
+	return slab->size;
+}
+
+void slab_free(void *ptr)
+{
+	struct slab *slab = (struct slab *)((size_t)ptr & ~(SLAB_SIZE - 1));
+	size_t offset = ptr - (void *)slab;
+	struct slab_cache *cache;
+
+	// Slabs past the used part of the region were never handed to a cache
+	if ((size_t)((void *)slab - region_start) >= __atomic_load_n(&region_used, __ATOMIC_RELAXED))
+		return;
+
+	cache = slab->cache;
+
+	slab_lock(cache);
+
+	// Ignore pointers that are not at the start of a handed out object
+	if (offset < SLAB_HEADER || offset >= slab->top || (offset - SLAB_HEADER) % slab->size != 0) {
+		slab_unlock(cache);
+		return;
+	}
+
+	*(void **)ptr = slab->free;
+	slab->free = ptr;
+	slab->used--;
+
+	if (!slab->listed)
+		list_add(&cache->partial[slab->class], slab);
+
+	// Hand an empty slab to any class, but keep the last one of its class
+	if (slab->used == 0 && (slab->prev != NULL || slab->next != NULL)) {
+		list_del(&cache->partial[slab->class], slab);
+		list_add(&cache->empty, slab);
+	}
+
+	slab_unlock(cache);
+}
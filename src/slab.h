@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Slabs of small objects, built with OSMEM_SLAB.
+ *
+ * Requests of up to SLAB_MAX_SIZE bytes are rounded up to a size class and
+ * packed into page-sized slabs of that class. Objects carry no metadata: the
+ * slab they are in, and so their size, follows from their address.
+ */
+#define SLAB_MAX_SIZE	512
+
+#ifdef OSMEM_SLAB
+
+/* Return an object of at least `size` bytes, or NULL if there are no slabs left */
+void *slab_alloc(size_t size);
+
+/* Fill `ptrs` with up to `count` objects of `size` bytes, return how many */
+size_t slab_alloc_batch(size_t size, size_t count, void **ptrs);
+
+/* Return whether `ptr` points into the slabs */
+int slab_owns(void *ptr);
+
+/* Return the size of the object at `ptr` */
+size_t slab_size(void *ptr);
+
+/* Free the object at `ptr` */
+void slab_free(void *ptr);
+
+#else
+
+static inline void *slab_alloc(size_t size)
+{
+	(void)size;
+	return NULL;
+}
+
+static inline size_t slab_alloc_batch(size_t size, size_t count, void **ptrs)
+{
+	(void)size;
+	(void)count;
+	(void)ptrs;
+	return 0;
+}
+
+static inline int slab_owns(void *ptr)
+{
+	(void)ptr;
+	return 0;
+}
+
+static inline size_t slab_size(void *ptr)
+{
+	(void)ptr;
+	return 0;
+}
+
+static inline void slab_free(void *ptr)
+{
+	(void)ptr;
+}
+
+#endif
@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <pthread.h>
+
+#include "osmem.h"
+#include "block_meta.h"
+#include "tcache.h"
+
+/*
+ * One bin per payload size up to TCACHE_MAX_SIZE, each holding at most
+ * TCACHE_COUNT blocks. Frees beyond that go to the shared heap, so a thread
+ * never hoards much memory, and its bins are emptied when it exits.
+ */
+#define TCACHE_MAX_SIZE	1024
+#define TCACHE_BINS	(TCACHE_MAX_SIZE / ALIGNMENT)
+#define TCACHE_COUNT	7
+
+struct tcache {
+	struct block_meta *bins[TCACHE_BINS];
+	unsigned char counts[TCACHE_BINS];
+	int registered;
+};
+
+static __thread struct tcache tcache;
+
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+
+static void tcache_flush(void *arg)
+{
+	struct tcache *cache = arg;
+	struct block_meta *block;
+	int bin;
+
+	// Return every cached block to the shared heap
+	for (bin = 0; bin < TCACHE_BINS; bin++) {
+		while (cache->bins[bin] != NULL) {
+			block = cache->bins[bin];
+			cache->bins[bin] = block->next;
+			block->status = STATUS_ALLOC;
+			block->next = NULL;
+
+			heap_free(block);
+		}
+
+		cache->counts[bin] = 0;
+	}
+
+	// Blocks freed by later destructors register the cache again
+	cache->registered = 0;
+}
+
+static void tcache_create_key(void)
+{
+	pthread_key_create(&tcache_key, tcache_flush);
+}
+
+static int tcache_bin(size_t payload)
+{
+	return payload / ALIGNMENT - 1;
+}
+
+void *tcache_get(size_t size)
+{
+	struct block_meta *block;
+	int bin;
+
+	if (size > TCACHE_MAX_SIZE)
+		return NULL;
+
+	bin = tcache_bin(size);
+	block = tcache.bins[bin];
+
+	if (block == NULL)
+		return NULL;
+
+	// Pop the most recently freed block
+	tcache.bins[bin] = block->next;
+	tcache.counts[bin]--;
+	block->status = STATUS_ALLOC;
+	block->next = NULL;
+
+	return (void *)block + BLOCK_META_SIZE;
+}
+
+int tcache_put(struct block_meta *block)
+{
+	size_t payload;
+	int bin;
+
+	// Only allocated heap blocks are cached, not free or already cached ones
+	if (block->status != STATUS_ALLOC)
+		return 0;
+
+	payload = block->size - BLOCK_META_SIZE;
+
+	if (payload == 0 || payload > TCACHE_MAX_SIZE)
+		return 0;
+
+	bin = tcache_bin(payload);
+
+	if (tcache.counts[bin] >= TCACHE_COUNT)
+		return 0;
+
+	// The destructor of the key flushes the cache when the thread exits
+	if (!tcache.registered) {
+		pthread_once(&tcache_once, tcache_create_key);
+		pthread_setspecific(tcache_key, &tcache);
+		tcache.registered = 1;
+	}
+
+	block->status = STATUS_CACHED;
+	block->next = tcache.bins[bin];
+	tcache.bins[bin] = block;
+	tcache.counts[bin]++;
+
+	return 1;
+}
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include "block_meta.h"
+
+/*
+ * Per-thread caches of small heap blocks, built with OSMEM_THREADS.
+ *
+ * A cached block has STATUS_CACHED, so the shared heap never looks at it, the
+ * owning thread can hand it out again without taking the heap lock, and a
+ * second free or a realloc of the block is rejected like for a free block. The
+ * blocks of a bin are linked through `next`, which allocated blocks never use.
+ */
+#ifdef OSMEM_THREADS
+
+/* Return a cached block with a payload of exactly `size` bytes, or NULL */
+void *tcache_get(size_t size);
+
+/* Cache a small heap block, return 0 if it is not cacheable or its bin is full */
+int tcache_put(struct block_meta *block);
+
+/* Give a block back to the shared heap, taking the lock (see osmem.c) */
+void heap_free(struct block_meta *block);
+
+#else
+
+static inline void *tcache_get(size_t size)
+{
+	(void)size;
+	return NULL;
+}
+
+static inline int tcache_put(struct block_meta *block)
+{
+	(void)block;
+	return 0;
+}
+
+#endif
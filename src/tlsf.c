@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "osmem.h"
+#include "block_meta.h"
+#include "tlsf.h"
+#include "free_index.h"
+
+/*
+ * Two-level segregated fit.
+ *
+ * The first level splits sizes by powers of two and the second level splits
+ * every power of two in SL_COUNT equal ranges. Sizes below SMALL_BLOCK all go
+ * in the first level, one exact class per ALIGNMENT step. A bitmap per level
+ * marks the non-empty lists, so every operation is a handful of bit scans.
+ *
+ * Requests are rounded up to the next class, so the head of the first
+ * non-empty list is always big enough: this is a good fit, not a best fit.
+ * Lists are doubly linked through the `prev` and `next` fields of free blocks.
+ */
+static int fls_size(size_t size)
+{
+	return 63 - __builtin_clzl(size);
+}
+
+static void mapping_insert(size_t size, int *fl, int *sl)
+{
+	if (size < SMALL_BLOCK) {
+		*fl = 0;
+		*sl = size / (SMALL_BLOCK / SL_COUNT);
+		return;
+	}
+
+	*fl = fls_size(size);
+	*sl = (size >> (*fl - SL_SHIFT)) ^ (1 << SL_SHIFT);
+	*fl -= FL_SHIFT - 1;
+}
+
+static void mapping_search(size_t size, int *fl, int *sl)
+{
+	// Round up to the next class, so any block found there fits
+	if (size >= SMALL_BLOCK)
+		size += (1UL << (fls_size(size) - SL_SHIFT)) - 1;
+
+	mapping_insert(size, fl, sl);
+}
+
+void free_index_insert(struct free_index *index, struct block_meta *block)
+{
+	int fl, sl;
+
+	mapping_insert(block->size, &fl, &sl);
+
+	// Push the block at the head of its list
+	block->prev = NULL;
+	block->next = index->blocks[fl][sl];
+
+	if (block->next != NULL)
+		block->next->prev = block;
+
+	index->blocks[fl][sl] = block;
+
+	index->fl_bitmap |= 1UL << fl;
+	index->sl_bitmap[fl] |= 1U << sl;
+}
+
+void free_index_remove(struct free_index *index, struct block_meta *block)
+{
+	int fl, sl;
+
+	mapping_insert(block->size, &fl, &sl);
+
+	if (block->prev != NULL)
+		block->prev->next = block->next;
+	else if (index->blocks[fl][sl] == block)
+		index->blocks[fl][sl] = block->next;
+	else
+		return;
+
+	if (block->next != NULL)
+		block->next->prev = block->prev;
+
+	// Clear the bits of a list that became empty
+	if (index->blocks[fl][sl] == NULL) {
+		index->sl_bitmap[fl] &= ~(1U << sl);
+
+		if (index->sl_bitmap[fl] == 0)
+			index->fl_bitmap &= ~(1UL << fl);
+	}
+
+	block->prev = NULL;
+	block->next = NULL;
+}
+
+struct block_meta *free_index_find(struct free_index *index, size_t size)
+{
+	int fl, sl;
+	unsigned int sl_map;
+	unsigned long fl_map;
+
+	mapping_search(size, &fl, &sl);
+
+	if (fl >= FL_COUNT)
+		return NULL;
+
+	// Look for a non-empty list in the same power of two first
+	sl_map = index->sl_bitmap[fl] & (~0U << sl);
+
+	if (sl_map == 0) {
+		// Then for the smallest non-empty power of two above it
+		fl_map = fl + 1 < FL_COUNT ? index->fl_bitmap & (~0UL << (fl + 1)) : 0;
+
+		if (fl_map == 0)
+			return NULL;
+
+		fl = __builtin_ctzl(fl_map);
+		sl_map = index->sl_bitmap[fl];
+	}
+
+	sl = __builtin_ctz(sl_map);
+
+	return index->blocks[fl][sl];
+}
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include "block_meta.h"
+
+/* Two-level segregated fit, see tlsf.c */
+#define SL_SHIFT	4
+#define SL_COUNT	(1 << SL_SHIFT)
+#define FL_SHIFT	(SL_SHIFT + 3)
+#define SMALL_BLOCK	(1UL << FL_SHIFT)
+#define FL_COUNT	(64 - FL_SHIFT + 1)
+
+struct free_index {
+	struct block_meta *blocks[FL_COUNT][SL_COUNT];
+	unsigned long fl_bitmap;
+	unsigned int sl_bitmap[FL_COUNT];
+};
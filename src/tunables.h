@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Policy knobs of the heaps (osmem.c). They start out with the values the
+ * library was built with and are changed at run time by os_mallopt(), or by
+ * the OSMEM_CONF environment variable when the library is loaded (mallopt.c).
+ */
+extern size_t trim_threshold;
+extern size_t mmap_threshold;
+extern size_t mmap_threshold_min;
+extern size_t mmap_threshold_max;
+extern int mmap_threshold_set;
+extern size_t heap_prealloc;
+extern size_t split_min;
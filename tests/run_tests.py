@@ -50,6 +50,25 @@ TESTS = {
     "test-all": 5,
 }
 
+# Tests of the extensions of the allocator, which are not graded, with the
+# environment they run in
+API_TESTS = {
+    "test-mmap-cache": {},
+    "test-purge": {},
+    "test-calloc-zero": {},
+    "test-mmap-threshold": {},
+    "test-realloc-fast": {},
+    "test-malloc-trim": {},
+    "test-malloc-huge": {},
+    "test-mallopt-conf": {"OSMEM_CONF": "mmap_threshold:64k,trim_threshold:4x,split_min,heap_prealloc:256k"},
+    "test-memalign": {},
+    "test-free-sized": {},
+    "test-malloc-batch": {},
+    "test-region": {},
+    "test-pool": {},
+    "test-heap": {},
+}
+
 
 class UnfinishedCall(Exception):
     def __init__(self, *args: object) -> None:
@@ -74,23 +93,33 @@ class Call:
     def add_nested_calls(self, nested_calls: list = None) -> None:
         self.nested_calls = nested_calls.copy() if nested_calls else []
 
-    def prettify(self, heap_start, mmaps: dict) -> str:
+    def prettify(self, heap_start, mmaps: dict, mappings: list = ()) -> str:
         self.args = list(
             map(
-                lambda arg: self.interpret_addr(arg, heap_start, mmaps),
+                lambda arg: self.interpret_addr(arg, heap_start, mmaps, mappings),
                 self.args,
             )
         )
-        self.ret = self.interpret_addr(self.ret, heap_start, mmaps)
+        self.ret = self.interpret_addr(self.ret, heap_start, mmaps, mappings)
 
         if self.name == "mmap":
             self.interpret_mmap_args()
 
     @staticmethod
-    def interpret_addr(addr: str, heap_start: int, mmaps: dict) -> str:
+    def interpret_addr(
+        addr: str, heap_start: int, mmaps: dict, mappings: list = ()
+    ) -> str:
         if "0x" in addr:
-            heap_addr = "HeapStart + " + hex(int(addr, 16) - heap_start)
-            return mmaps.get(addr, heap_addr)
+            if addr in mmaps:
+                return mmaps[addr]
+
+            # Addresses inside a mapping are shown relative to it, newest first
+            value = int(addr, 16)
+            for start, length, label in reversed(mappings):
+                if start <= value < start + length:
+                    return f"{label} + {hex(value - start)}"
+
+            return "HeapStart + " + hex(value - heap_start)
 
         return addr
 
@@ -153,9 +182,16 @@ class LtraceParser:
         "os_calloc",
         "os_realloc",
         "os_free",
+        "os_memalign",
+        "os_aligned_alloc",
+        "os_mallopt",
+        "os_region_",
+        "os_pool_",
+        "os_heap_",
         "brk",
         "mmap",
         "munmap",
+        "madvise",
     ]
 
     def __init__(self, program_output, output) -> None:
@@ -179,6 +215,7 @@ class LtraceParser:
         self.line_index = 0
 
         self.mmaps = {}
+        self.mappings = []
         self.mmaps_count = 1
         self.block_size = 0x20
 
@@ -216,6 +253,7 @@ class LtraceParser:
             line.startswith("brk")
             or line.startswith("mmap")
             or line.startswith("munmap")
+            or line.startswith("madvise")
         ):
             return False
 
@@ -249,8 +287,15 @@ class LtraceParser:
                     self.mmaps[
                         payload_start
                     ] = f"<mapped-addr{self.mmaps_count}> + {hex(self.block_size)}"
+                    self.mappings.append(
+                        (
+                            int(syscalls[-1].ret, 16),
+                            int(syscalls[-1].args[1]),
+                            f"<mapped-addr{self.mmaps_count}>",
+                        )
+                    )
                     self.mmaps_count += 1
-                syscalls[-1].prettify(self.heap_start, self.mmaps)
+                syscalls[-1].prettify(self.heap_start, self.mmaps, self.mappings)
 
             self.line_index += 1
 
@@ -259,7 +304,7 @@ class LtraceParser:
         except UnfinishedCall:
             return None
 
-        libcall.prettify(self.heap_start, self.mmaps)
+        libcall.prettify(self.heap_start, self.mmaps, self.mappings)
         libcall.add_nested_calls(syscalls)
 
         return libcall
@@ -293,7 +338,7 @@ class Test:
     SNIPPET_DIR = os.path.join(os.path.dirname(os.path.realpath(__file__)), "snippets")
     REF_DIR = os.path.join(os.path.dirname(os.path.realpath(__file__)), "ref")
 
-    def __init__(self, name, points) -> None:
+    def __init__(self, name, points, env=None) -> None:
         if "snippets/" in name:
             name = os.path.basename(name)
 
@@ -307,6 +352,7 @@ class Test:
 
         self.env = os.environ.copy()
         self.env["LD_LIBRARY_PATH"] = os.environ.get("SRC_PATH", Test.SRC_PATH)
+        self.env.update(env if env is not None else API_TESTS.get(name, {}))
 
         print(self.name.ljust(33) + 24 * ".", end="")
 
@@ -344,8 +390,8 @@ class Test:
             memcheck = True
 
         debug_msg = " debug"
-        pass_msg = f" passed ...   {self.points}"
-        fail_msg = " failed ...   0"
+        pass_msg = f" passed ...   {self.points}" if self.points is not None else " passed"
+        fail_msg = " failed ...   0" if self.points is not None else " failed"
 
         diff_err = ""
         memcheck_err = ""
@@ -475,6 +521,12 @@ def main():
 
     print("\nTotal:" + " " * 59 + f" {total}/100")
 
+    print()
+    for test_name, env in API_TESTS.items():
+        test = Test(test_name, None, env)
+        test.run()
+        test.grade(verbose, diff, memcheck)
+
 
 if __name__ == "__main__":
     main()
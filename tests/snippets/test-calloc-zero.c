@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define HEAP_MAX		(512 * MULT_KB)
+#define MAPPED_SZ		(200 * MULT_KB)
+#define HEAP_SZ			(300 * MULT_KB)
+#define DIRTY_SZ		(100 * MULT_KB)
+
+static int is_zero(void *ptr, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		if (((char *)ptr)[i] != 0)
+			return 0;
+
+	return 1;
+}
+
+int main(void)
+{
+	void *ptr1, *ptr2, *ptr3, *ptr4, *guard;
+
+	/* A fresh mapping is not written, so its pages are not faulted in */
+	ptr1 = os_calloc(1, MAPPED_SZ);
+	FAIL(ptr1 == NULL, "DBG: os_calloc returned NULL on valid size");
+	FAIL(resident_pages(ptr1, ptr1 + MAPPED_SZ) != 0, "DBG: os_calloc zeroed a fresh mapping");
+	FAIL(!is_zero(ptr1, MAPPED_SZ), "DBG: os_calloc returned uninitialized memory");
+
+	/* Zeroed blocks below the threshold go on the heap once it is set */
+	FAIL(os_mallopt(OS_M_MMAP_THRESHOLD, HEAP_MAX) != 1, "DBG: os_mallopt refused the mmap threshold");
+
+	/* The heap fresh from sbrk is not written either */
+	ptr2 = os_calloc(1, HEAP_SZ);
+	FAIL(ptr2 == NULL, "DBG: os_calloc returned NULL on valid size");
+	FAIL(resident_pages(ptr2, ptr2 + HEAP_SZ) != 0, "DBG: os_calloc zeroed the fresh heap");
+	FAIL(!is_zero(ptr2, HEAP_SZ), "DBG: os_calloc returned uninitialized memory");
+
+	/* A reused block may hold stale data, so it is zeroed */
+	ptr3 = os_malloc_checked(DIRTY_SZ);
+	guard = os_malloc_checked(100);
+	taint(ptr3, DIRTY_SZ);
+	os_free(ptr3);
+
+	ptr4 = os_calloc_checked(1, DIRTY_SZ);
+	FAIL(ptr4 != ptr3, "DBG: os_calloc did not reuse the free block");
+
+	/* Cleanup */
+	os_free(guard);
+	os_free(ptr4);
+	os_free(ptr2);
+	os_free(ptr1);
+
+	return 0;
+}
@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+int main(void)
+{
+	void *prealloc_ptr, *ptr1, *ptr2, *ptr3;
+
+	prealloc_ptr = mock_preallocate();
+	os_free_sized(prealloc_ptr, MOCK_PREALLOC);
+
+	/* Heap blocks go back to the free blocks of the heap */
+	ptr1 = os_malloc_checked(100);
+	ptr2 = os_malloc_checked(1000);
+	os_free_sized(ptr1, 100);
+
+	/* Any size up to the usable one is accepted */
+	os_free_sized(ptr2, 996);
+
+	/* Blocks freed twice and NULL are ignored */
+	os_free_sized(ptr2, 1000);
+	os_free_sized(NULL, 100);
+
+	/* The freed blocks are reused */
+	ptr1 = os_malloc_checked(1100);
+
+	/* Mapped blocks are unmapped */
+	ptr3 = os_malloc_checked(MMAP_THRESHOLD);
+	os_free_sized(ptr3, MMAP_THRESHOLD);
+
+	/* Cleanup */
+	os_free_sized(ptr1, 1100);
+
+	return 0;
+}
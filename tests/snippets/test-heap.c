@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define SEGMENT_SZ		(1024 * MULT_KB)
+
+int main(void)
+{
+	void *ptr1, *ptr2, *ptr3, *ptr4;
+	os_heap_t *heap;
+	size_t size;
+
+	/* The heap sits in its first segment */
+	heap = os_heap_create(SEGMENT_SZ);
+	FAIL(heap == NULL, "DBG: os_heap_create returned NULL");
+	FAIL(os_heap_used(heap) != 0, "DBG: os_heap_used is not 0 for a new heap");
+
+	/* Blocks count with their metadata */
+	ptr1 = os_heap_malloc(heap, 1000);
+	ptr2 = os_heap_malloc(heap, 2000);
+	FAIL(ptr1 == NULL || ptr2 == NULL, "DBG: os_heap_malloc returned NULL on valid size");
+	FAIL(os_heap_used(heap) != 3000 + 2 * METADATA_SIZE, "DBG: os_heap_used does not count the blocks");
+	size = os_heap_size(heap);
+	FAIL(size < os_heap_used(heap), "DBG: os_heap_size is smaller than the used bytes");
+
+	/* Freed blocks are reused */
+	os_heap_free(heap, ptr1);
+	FAIL(os_heap_used(heap) != 2000 + METADATA_SIZE, "DBG: os_heap_free did not update the used bytes");
+	ptr3 = os_heap_malloc(heap, 500);
+	FAIL(ptr3 != ptr1, "DBG: os_heap_malloc did not reuse the freed block");
+
+	/* Pointers of other heaps are ignored */
+	ptr4 = os_malloc_checked(100);
+	os_heap_free(heap, ptr4);
+	os_free(ptr4);
+
+	/* A block too big for a segment gets a segment of its own */
+	ptr4 = os_heap_malloc(heap, 2 * SEGMENT_SZ);
+	FAIL(ptr4 == NULL, "DBG: os_heap_malloc returned NULL on valid size");
+	FAIL(os_heap_size(heap) < size + 2 * SEGMENT_SZ, "DBG: os_heap_size does not count the new segment");
+
+	/* Destroying the heap unmaps all of its segments */
+	os_heap_destroy(heap);
+
+	return 0;
+}
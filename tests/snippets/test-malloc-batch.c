@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define BATCH_SZ		8
+
+int main(void)
+{
+	void **ptrs1, **ptrs2, **ptrs3;
+	void *prealloc_ptr;
+	int i;
+
+	prealloc_ptr = mock_preallocate();
+
+	/* The arrays are on the heap so that their addresses show in the trace */
+	ptrs1 = os_malloc_checked(BATCH_SZ * sizeof(void *));
+	ptrs2 = os_malloc_checked(BATCH_SZ * sizeof(void *));
+	ptrs3 = os_malloc_checked((BATCH_SZ + 3) * sizeof(void *));
+	os_free(prealloc_ptr);
+
+	/* A batch of small blocks is carved out of one free block */
+	FAIL(os_malloc_batch(100, BATCH_SZ, ptrs1) != BATCH_SZ, "DBG: os_malloc_batch returned a partial batch");
+	for (i = 1; i < BATCH_SZ; i++)
+		FAIL(ptrs1[i] != ptrs1[i - 1] + 104 + METADATA_SIZE, "DBG: os_malloc_batch did not pack the blocks");
+
+	/* Free part of the batch, the holes are reused by the next one */
+	os_free_batch(ptrs1 + 2, 3);
+	FAIL(os_malloc_batch(40, 4, ptrs2) != 4, "DBG: os_malloc_batch returned a partial batch");
+	FAIL(ptrs2[0] != ptrs1[2], "DBG: os_malloc_batch did not reuse the freed blocks");
+
+	/* The rest of a batch is freed like any block */
+	os_free(ptrs1[0]);
+	os_free(ptrs1[5]);
+
+	/* A batch of large blocks is mapped block by block */
+	FAIL(os_malloc_batch(MMAP_THRESHOLD, 2, ptrs2 + 4) != 2, "DBG: os_malloc_batch returned a partial batch");
+
+	/* Heap and mapped blocks, NULL and freed entries are freed together */
+	ptrs3[0] = NULL;
+	ptrs3[1] = ptrs1[0];
+	for (i = 0; i < BATCH_SZ - 2; i++)
+		ptrs3[2 + i] = ptrs2[i];
+	ptrs3[BATCH_SZ] = ptrs1[6];
+	ptrs3[BATCH_SZ + 1] = ptrs1[7];
+	ptrs3[BATCH_SZ + 2] = NULL;
+	os_free_batch(ptrs3, BATCH_SZ + 3);
+
+	/* Nothing to allocate */
+	FAIL(os_malloc_batch(0, BATCH_SZ, ptrs1) != 0, "DBG: os_malloc_batch allocated zero sized blocks");
+
+	/* Cleanup */
+	os_free(ptrs1);
+	os_free(ptrs2);
+	os_free(ptrs3);
+
+	return 0;
+}
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+
+#include "test-utils.h"
+
+#define HUGE_SZ			(SIZE_MAX - 10)
+
+int main(void)
+{
+	void **ptrs;
+	void *ptr;
+
+	ptr = os_malloc_checked(100);
+	ptrs = os_malloc_checked(2 * sizeof(void *));
+
+	/* Sizes that would wrap once aligned are refused before any syscall */
+	FAIL(os_malloc(HUGE_SZ) != NULL, "DBG: os_malloc returned a block for a huge size");
+	FAIL(os_malloc((size_t)PTRDIFF_MAX + 1) != NULL, "DBG: os_malloc returned a block past PTRDIFF_MAX");
+	FAIL(os_calloc(1, HUGE_SZ) != NULL, "DBG: os_calloc returned a block for a huge size");
+	FAIL(os_memalign(64, HUGE_SZ) != NULL, "DBG: os_memalign returned a block for a huge size");
+	FAIL(os_malloc_batch(HUGE_SZ, 2, ptrs) != 0, "DBG: os_malloc_batch returned blocks for a huge size");
+
+	/* A block that cannot grow that much is left as it is */
+	memset(ptr, 0x5a, 100);
+	FAIL(os_realloc(ptr, HUGE_SZ) != NULL, "DBG: os_realloc grew a block to a huge size");
+	FAIL(((char *)ptr)[99] != 0x5a, "DBG: os_realloc changed the block it refused to grow");
+
+	/* Cleanup */
+	os_free(ptr);
+	os_free(ptrs);
+
+	return 0;
+}
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define TEST_TRIM_PAD			(16 * MULT_KB)
+#define TEST_TRIM_THRESHOLD		(64 * MULT_KB)
+
+int main(void)
+{
+	void *prealloc_ptr, *ptr1, *ptr2, *ptr3;
+
+	prealloc_ptr = mock_preallocate();
+
+	/* Grow the heap past the preallocated chunk and free its end */
+	ptr1 = os_malloc_checked(100 * MULT_KB);
+	ptr2 = os_malloc_checked(100 * MULT_KB);
+	os_free(ptr2);
+	os_free(ptr1);
+
+	/* Trim keeping a pad, then trim the rest */
+	FAIL(os_malloc_trim(TEST_TRIM_PAD) != 1, "DBG: os_malloc_trim did not lower the break");
+	FAIL(os_malloc_trim(0) != 1, "DBG: os_malloc_trim did not release the pad");
+	FAIL(os_malloc_trim(0) != 0, "DBG: os_malloc_trim released memory twice");
+
+	/* The heap grows back from the trimmed end */
+	ptr1 = os_malloc_checked(100 * MULT_KB);
+
+	/* Freeing more than the threshold at the end of the heap trims it */
+	FAIL(os_mallopt(OS_M_TRIM_THRESHOLD, TEST_TRIM_THRESHOLD) != 1, "DBG: os_mallopt refused the trim threshold");
+	ptr2 = os_malloc_checked(100 * MULT_KB);
+	ptr3 = os_malloc_checked(100);
+	os_free(ptr3);
+	os_free(ptr2);
+
+	/* Cleanup */
+	os_free(ptr1);
+	os_free(prealloc_ptr);
+
+	return 0;
+}
@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+/*
+ * Runs with OSMEM_CONF=mmap_threshold:64k,trim_threshold:4x,split_min,heap_prealloc:256k
+ * so the heap is preallocated in 256 KiB, blocks are mapped from 64 KiB on and
+ * the malformed pairs leave the heap untrimmed and split as usual.
+ */
+int main(void)
+{
+	void *ptr1, *ptr2, *ptr3, *ptr4, *ptr5;
+
+	/* The heap is preallocated with the configured size */
+	ptr1 = os_malloc_checked(60 * MULT_KB);
+
+	/* The configured threshold maps smaller blocks */
+	ptr2 = os_malloc_checked(70 * MULT_KB);
+
+	/* Zeroed blocks follow the configured threshold too */
+	ptr3 = os_calloc_checked(1, 60 * MULT_KB);
+
+	/* Invalid parameters and values are refused */
+	FAIL(os_mallopt(OS_M_MMAP_THRESHOLD, 16) != 0, "DBG: os_mallopt accepted a threshold below a block");
+	FAIL(os_mallopt(OS_M_TRIM_THRESHOLD, -1) != 0, "DBG: os_mallopt accepted a negative value");
+	FAIL(os_mallopt(0, 4096) != 0, "DBG: os_mallopt accepted an unknown parameter");
+
+	/* Lowering the bound pulls the threshold down with it */
+	FAIL(os_mallopt(OS_M_MMAP_THRESHOLD_MAX, 32 * MULT_KB) != 1, "DBG: os_mallopt refused the threshold bound");
+	ptr4 = os_malloc_checked(40 * MULT_KB);
+
+	/* The free end of the heap is not trimmed */
+	os_free(ptr1);
+	ptr5 = os_malloc_checked(100);
+
+	/* Cleanup */
+	os_free(ptr2);
+	os_free(ptr3);
+	os_free(ptr4);
+	os_free(ptr5);
+
+	return 0;
+}
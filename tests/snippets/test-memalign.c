@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define IS_ALIGNED(ptr, alignment)	(((unsigned long)(ptr) & ((alignment) - 1)) == 0)
+
+int main(void)
+{
+	void *prealloc_ptr, *ptr1, *ptr2, *ptr3, *ptr4, *ptr5;
+
+	prealloc_ptr = mock_preallocate();
+	os_free(prealloc_ptr);
+
+	/* Small alignments are those of every payload */
+	ptr1 = os_memalign(8, 100);
+	FAIL(ptr1 == NULL || !IS_ALIGNED(ptr1, 8), "DBG: os_memalign returned a misaligned block");
+
+	/* Larger alignments are carved out of the heap */
+	ptr2 = os_memalign(64, 100);
+	FAIL(ptr2 == NULL || !IS_ALIGNED(ptr2, 64), "DBG: os_memalign returned a misaligned block");
+
+	ptr3 = os_aligned_alloc(4096, 5000);
+	FAIL(ptr3 == NULL || !IS_ALIGNED(ptr3, 4096), "DBG: os_aligned_alloc returned a misaligned block");
+	FAIL(os_malloc_usable_size(ptr3) < 5000, "DBG: os_aligned_alloc returned a short block");
+
+	/* Large blocks are mapped with the alignment */
+	ptr4 = os_memalign(4096, 200 * MULT_KB);
+	FAIL(ptr4 == NULL || !IS_ALIGNED(ptr4, 4096), "DBG: os_memalign returned a misaligned block");
+
+	/* Alignments that are not powers of two are refused */
+	ptr5 = os_memalign(48, 100);
+	FAIL(ptr5 != NULL, "DBG: os_memalign accepted an alignment that is not a power of two");
+	ptr5 = os_memalign(0, 100);
+	FAIL(ptr5 != NULL, "DBG: os_memalign accepted a zero alignment");
+
+	/* Cleanup */
+	os_free(ptr1);
+	os_free(ptr2);
+	os_free(ptr3);
+	os_free(ptr4);
+
+	return 0;
+}
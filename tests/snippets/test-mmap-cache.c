@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define CACHE_MAX		(1024 * MULT_KB)
+#define CACHE_DECAY		(60 * 1000)
+
+int main(void)
+{
+	void *ptr1, *ptr2, *ptr3, *ptr4;
+
+	FAIL(os_mallopt(OS_M_MMAP_CACHE_MAX, CACHE_MAX) != 1, "DBG: os_mallopt refused the cache size");
+	FAIL(os_mallopt(OS_M_MMAP_CACHE_DECAY, CACHE_DECAY) != 1, "DBG: os_mallopt refused the cache decay");
+
+	/* A freed mapped block is kept instead of unmapped */
+	ptr1 = os_malloc_checked(200 * MULT_KB);
+	os_free(ptr1);
+
+	/* A smaller block reuses the mapping without a new mmap */
+	ptr2 = os_malloc_checked(180 * MULT_KB);
+	FAIL(ptr2 != ptr1, "DBG: os_malloc did not reuse the cached mapping");
+	os_free(ptr2);
+
+	/* A block more than twice as big as the request is not reused */
+	ptr3 = os_malloc_checked(600 * MULT_KB);
+	os_free(ptr3);
+	ptr2 = os_malloc_checked(MMAP_THRESHOLD);
+	FAIL(ptr2 == ptr3, "DBG: os_malloc reused a mapping more than twice its size");
+	os_free(ptr2);
+
+	/* Going past the cache size unmaps the block freed the longest ago */
+	ptr4 = os_malloc_checked(700 * MULT_KB);
+	os_free(ptr4);
+
+	return 0;
+}
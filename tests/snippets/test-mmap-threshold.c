@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define THRESHOLD_MAX		(1024 * MULT_KB)
+
+int main(void)
+{
+	void *ptr1, *ptr2, *ptr3;
+
+	/* Let the threshold slide up to 1MB */
+	FAIL(os_mallopt(OS_M_MMAP_THRESHOLD_MAX, THRESHOLD_MAX) != 1, "DBG: os_mallopt refused the threshold max");
+
+	/* Blocks past the threshold are mapped */
+	ptr1 = os_malloc_checked(200 * MULT_KB);
+
+	/* Freeing it raises the threshold past its size */
+	os_free(ptr1);
+
+	/* The same size now goes on the heap, which is preallocated big enough for it */
+	ptr1 = os_malloc_checked(200 * MULT_KB);
+	ptr2 = os_malloc_checked(150 * MULT_KB);
+
+	/* Larger blocks are still mapped and raise the threshold again */
+	ptr3 = os_malloc_checked(300 * MULT_KB);
+	os_free(ptr3);
+	ptr3 = os_malloc_checked(300 * MULT_KB);
+	os_free(ptr3);
+
+	/* Blocks past the max are mapped and leave the threshold where it is */
+	ptr3 = os_malloc_checked(2 * THRESHOLD_MAX);
+	os_free(ptr3);
+	ptr3 = os_malloc_checked(THRESHOLD_MAX / 2);
+
+	/* Cleanup */
+	os_free(ptr3);
+	os_free(ptr2);
+	os_free(ptr1);
+
+	return 0;
+}
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+
+#include "test-utils.h"
+
+#define IS_ALIGNED(ptr, alignment)	(((unsigned long)(ptr) & ((alignment) - 1)) == 0)
+#define NUM_OBJS		4
+
+int main(void)
+{
+	os_pool_t *pool1, *pool2;
+	void *ptrs[NUM_OBJS];
+	void *ptr;
+	int i;
+
+	/* Objects are packed at their size rounded up to the alignment */
+	pool1 = os_pool_create(40, 64);
+	FAIL(pool1 == NULL, "DBG: os_pool_create returned NULL");
+	for (i = 0; i < NUM_OBJS; i++) {
+		ptrs[i] = os_pool_alloc(pool1);
+		FAIL(ptrs[i] == NULL || !IS_ALIGNED(ptrs[i], 64), "DBG: os_pool_alloc returned a misaligned object");
+		FAIL(i > 0 && ptrs[i] != ptrs[i - 1] + 64, "DBG: os_pool_alloc did not pack the objects");
+	}
+
+	/* The most recently freed object is handed out first */
+	os_pool_free(pool1, ptrs[1]);
+	os_pool_free(pool1, ptrs[2]);
+	os_pool_free(pool1, NULL);
+	ptr = os_pool_alloc(pool1);
+	FAIL(ptr != ptrs[2], "DBG: os_pool_alloc did not reuse the last freed object");
+	ptr = os_pool_alloc(pool1);
+	FAIL(ptr != ptrs[1], "DBG: os_pool_alloc did not reuse the freed objects in LIFO order");
+
+	/* Big objects get blocks of a few of them, which are mapped */
+	pool2 = os_pool_create(10000, 0);
+	FAIL(pool2 == NULL, "DBG: os_pool_create returned NULL");
+	ptr = os_pool_alloc(pool2);
+	FAIL(ptr == NULL || !IS_ALIGNED(ptr, 8), "DBG: os_pool_alloc returned a misaligned object");
+
+	/* Invalid and huge sizes and invalid alignments are refused */
+	FAIL(os_pool_create(0, 8) != NULL, "DBG: os_pool_create accepted a zero size");
+	FAIL(os_pool_create(40, 24) != NULL, "DBG: os_pool_create accepted an alignment that is not a power of two");
+	FAIL(os_pool_create(SIZE_MAX - 3, 8) != NULL, "DBG: os_pool_create accepted a size that wraps once aligned");
+	FAIL(os_pool_create(SIZE_MAX / 8, 8) != NULL, "DBG: os_pool_create accepted a size whose blocks wrap");
+
+	/* Cleanup */
+	os_pool_destroy(pool1);
+	os_pool_destroy(pool2);
+
+	return 0;
+}
@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define PURGE_MIN		(64 * MULT_KB)
+#define BLOCK_SZ		(100 * MULT_KB)
+
+int main(void)
+{
+	void *ptr1, *ptr2, *ptr3;
+
+	FAIL(os_mallopt(OS_M_PURGE_THRESHOLD, PURGE_MIN) != 1, "DBG: os_mallopt refused the purge threshold");
+	FAIL(os_mallopt(OS_M_PURGE_DECAY, 0) != 1, "DBG: os_mallopt refused the purge decay");
+
+	/* Touch a big block, so its pages are resident */
+	ptr1 = os_malloc_checked(BLOCK_SZ);
+	ptr2 = os_malloc_checked(100);
+	memset(ptr1, 1, BLOCK_SZ);
+
+	/* The next allocation purges the inner pages of the freed block */
+	os_free(ptr1);
+	ptr3 = os_malloc_checked(100);
+	FAIL(resident_pages(ptr1, ptr1 + BLOCK_SZ) != 0, "DBG: the free block was not purged");
+
+	/* Small free blocks are left alone */
+	os_free(ptr3);
+	ptr3 = os_malloc_checked(100);
+
+	/* The purged pages read as zeroes when the block is reused */
+	os_free(ptr3);
+	ptr3 = os_malloc_checked(BLOCK_SZ);
+	FAIL(ptr3 != ptr1, "DBG: os_malloc did not reuse the purged block");
+	FAIL(((char *)ptr3)[BLOCK_SZ / 2] != 0, "DBG: the purged pages kept their data");
+
+	/* Cleanup */
+	os_free(ptr2);
+	os_free(ptr3);
+
+	return 0;
+}
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "test-utils.h"
+
+#define SPLIT_MIN		(1 * MULT_KB)
+#define HEAP_SZ			4000
+#define MAPPED_SZ		(200 * MULT_KB)
+
+static int is_filled(void *ptr, int c, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		if (((unsigned char *)ptr)[i] != c)
+			return 0;
+
+	return 1;
+}
+
+int main(void)
+{
+	void *ptr1, *ptr2, *ptr3, *ptr4;
+
+	/* Only remainders of 1K or more are split off */
+	FAIL(os_mallopt(OS_M_SPLIT_MIN, SPLIT_MIN) != 1, "DBG: os_mallopt refused the split min");
+
+	ptr1 = os_malloc_checked(HEAP_SZ);
+	ptr2 = os_malloc_checked(100);
+	memset(ptr1, 0x5a, HEAP_SZ);
+
+	/* A heap block that still fits without a split stays where it is */
+	FAIL(os_realloc(ptr1, HEAP_SZ - 1000) != ptr1, "DBG: os_realloc moved a block that shrank in place");
+	FAIL(os_realloc(ptr1, HEAP_SZ - 100) != ptr1, "DBG: os_realloc moved a block that grew in place");
+	FAIL(!is_filled(ptr1, 0x5a, HEAP_SZ - 100), "DBG: os_realloc lost the data of the block");
+
+	/* Nothing was split off, so a small block goes past the guard */
+	ptr3 = os_malloc_checked(500);
+	FAIL(ptr3 < ptr2, "DBG: os_realloc split off a remainder smaller than the split min");
+
+	/* A mapping that shrinks by less than a page is kept */
+	ptr4 = os_malloc_checked(MAPPED_SZ);
+	memset(ptr4, 0xa5, MAPPED_SZ);
+	FAIL(os_realloc(ptr4, MAPPED_SZ - 2 * MULT_KB) != ptr4, "DBG: os_realloc moved a mapping that shrank by less than a page");
+	FAIL(!is_filled(ptr4, 0xa5, MAPPED_SZ - 2 * MULT_KB), "DBG: os_realloc lost the data of the mapping");
+
+	/* One that shrinks by more is resized */
+	ptr4 = os_realloc(ptr4, MAPPED_SZ - 64 * MULT_KB);
+	FAIL(ptr4 == NULL, "DBG: os_realloc returned NULL on valid size");
+	FAIL(!is_filled(ptr4, 0xa5, MAPPED_SZ - 64 * MULT_KB), "DBG: os_realloc lost the data of the mapping");
+
+	/* Cleanup */
+	os_free(ptr4);
+	os_free(ptr3);
+	os_free(ptr2);
+	os_free(ptr1);
+
+	return 0;
+}
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdint.h>
+
+#include "test-utils.h"
+
+#define CHUNK_SZ		(4 * MULT_KB)
+
+int main(void)
+{
+	void *ptrs[4];
+	os_region_t *region;
+	void *ptr;
+	int i;
+
+	region = os_region_create(CHUNK_SZ);
+	FAIL(region == NULL, "DBG: os_region_create returned NULL");
+
+	/* Allocations are bumped through the chunk, then a second chunk */
+	ptrs[0] = os_region_alloc(region, 1000);
+	ptrs[1] = os_region_alloc(region, 1000);
+	FAIL(ptrs[1] != ptrs[0] + 1000, "DBG: os_region_alloc did not bump the pointer");
+	ptrs[2] = os_region_alloc(region, 3000);
+
+	/* An allocation bigger than the mmap threshold gets a mapped chunk */
+	ptrs[3] = os_region_alloc(region, MMAP_THRESHOLD);
+	FAIL(os_region_alloc(region, 0) != NULL, "DBG: os_region_alloc allocated zero bytes");
+	FAIL(os_region_alloc(region, SIZE_MAX - 10) != NULL, "DBG: os_region_alloc allocated a huge size");
+
+	/* After a reset, the same allocations reuse the same chunks */
+	os_region_reset(region);
+	os_region_reset(region);
+	for (i = 0; i < 3; i++) {
+		ptr = os_region_alloc(region, i < 2 ? 1000 : 3000);
+		FAIL(ptr != ptrs[i], "DBG: os_region_alloc did not reuse the chunks after a reset");
+	}
+	ptr = os_region_alloc(region, MMAP_THRESHOLD);
+	FAIL(ptr != ptrs[3], "DBG: os_region_alloc did not reuse the mapped chunk after a reset");
+
+	/* Cleanup */
+	os_region_destroy(region);
+
+	return 0;
+}
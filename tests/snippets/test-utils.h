@@ -6,6 +6,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <sys/param.h>
+#include <sys/mman.h>
 #include "osmem.h"
 #include "block_meta.h"
 
@@ -52,6 +53,24 @@ void taint(void *ptr, size_t size)
 		memcpy(ptr + i, buf, MIN(4096, size - i));
 }
 
+/* Count the resident pages that lie whole between start and end */
+size_t resident_pages(void *start, void *end)
+{
+	size_t page = getpagesize();
+	unsigned char vec;
+	size_t count = 0;
+
+	start = (void *)(((size_t)start + page - 1) & ~(page - 1));
+	end = (void *)((size_t)end & ~(page - 1));
+
+	for (; start < end; start += page) {
+		DIE(mincore(start, page, &vec) < 0, "mincore");
+		count += vec & 1;
+	}
+
+	return count;
+}
+
 void *os_calloc_checked(size_t nmemb, size_t size)
 {
 	void *ptr = os_calloc(nmemb, size);
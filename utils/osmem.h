@@ -11,9 +11,24 @@
 #include <string.h>
 
 
+#ifndef ALIGNMENT
 #define ALIGNMENT 8
+#endif
 #define MMAP_THRESHHOLD 128 * 1024
 
+/* Bounds of the size from which blocks are mapped, equal bounds keep it fixed */
+#ifndef MMAP_THRESHOLD_MIN
+#define MMAP_THRESHOLD_MIN MMAP_THRESHHOLD
+#endif
+
+#ifndef MMAP_THRESHOLD_MAX
+#define MMAP_THRESHOLD_MAX MMAP_THRESHOLD_MIN
+#endif
+
+#ifndef TRIM_THRESHOLD
+#define TRIM_THRESHOLD 0
+#endif
+
 #define PROT_READ	0x1		/* Page can be read.  */
 #define PROT_WRITE	0x2		/* Page can be written.  */
 #define PROT_EXEC	0x4		/* Page can be executed.  */
@@ -30,7 +45,53 @@
 
 void *os_malloc(size_t size);
 void os_free(void *ptr);
+void os_free_sized(void *ptr, size_t size);
+size_t os_malloc_batch(size_t size, size_t count, void **ptrs);
+void os_free_batch(void **ptrs, size_t count);
 void *os_calloc(size_t nmemb, size_t size);
 void *os_realloc(void *ptr, size_t size);
 void coalesce_free_blocks();
+int os_malloc_trim(size_t pad);
+void *os_memalign(size_t alignment, size_t size);
+void *os_aligned_alloc(size_t alignment, size_t size);
+size_t os_malloc_usable_size(void *ptr);
+
+/* os_mallopt() parameters, OSMEM_CONF names them in lowercase without OS_M_ */
+#define OS_M_TRIM_THRESHOLD	1	/* Free bytes at the end of a heap that os_free() trims */
+#define OS_M_MMAP_THRESHOLD	2	/* Size from which blocks are mapped, it no longer slides */
+#define OS_M_MMAP_THRESHOLD_MAX	3	/* Bound the mmap threshold slides up to */
+#define OS_M_HEAP_PREALLOC	4	/* Size of the first chunk of a heap */
+#define OS_M_SPLIT_MIN		5	/* Smallest payload split off a bigger block */
+#define OS_M_MMAP_CACHE_MAX	6	/* Bytes of freed mapped blocks kept for reuse */
+#define OS_M_MMAP_CACHE_DECAY	7	/* Milliseconds after which cached blocks are unmapped */
+#define OS_M_PURGE_THRESHOLD	8	/* Size from which free heap blocks are purged */
+#define OS_M_PURGE_DECAY	9	/* Milliseconds after which free blocks are purged */
+#define OS_M_ARENA_MAX		10	/* Number of arenas of the threads */
+
+int os_mallopt(int param, long value);
+
+/* Regions: bump allocation from chunks, freed all at once (region.c) */
+typedef struct os_region os_region_t;
+
+os_region_t *os_region_create(size_t chunk_size);
+void *os_region_alloc(os_region_t *region, size_t size);
+void os_region_reset(os_region_t *region);
+void os_region_destroy(os_region_t *region);
+
+/* Pools of objects of one size, on an intrusive free list (pool.c) */
+typedef struct os_pool os_pool_t;
+
+os_pool_t *os_pool_create(size_t obj_size, size_t align);
+void *os_pool_alloc(os_pool_t *pool);
+void os_pool_free(os_pool_t *pool, void *ptr);
+void os_pool_destroy(os_pool_t *pool);
+
+/* Heaps of their own, in segments unmapped all at once (heap.c) */
+typedef struct os_heap os_heap_t;
 
+os_heap_t *os_heap_create(size_t segment_size);
+void *os_heap_malloc(os_heap_t *heap, size_t size);
+void os_heap_free(os_heap_t *heap, void *ptr);
+size_t os_heap_used(os_heap_t *heap);
+size_t os_heap_size(os_heap_t *heap);
+void os_heap_destroy(os_heap_t *heap);